@@ -4,8 +4,11 @@
 #pragma once
 
 #include <cstddef> // std::size_t
+#include <cstdint> // std::uint64_t, std::uint8_t
 #include <string>  // std::string
 
+#include "cache.hpp" // AccessHint (block placement hints)
+
 // Strategy used to choose a free block from the heap.
 enum class FitStrategy
 {
@@ -14,6 +17,19 @@ enum class FitStrategy
 	Worst,
 };
 
+// Parse a strategy name ("first", "best", "worst" and common variants);
+// unknown names fall back to first-fit.
+FitStrategy parse_strategy(const std::string &s);
+
+// Heap size used at (re)initialization and the default context's arena
+// (exposed for offset math in drivers; see allocator_set_heap_size).
+extern std::size_t HEAP_SIZE;
+extern std::uint8_t *g_heap;
+
+// Initialize the default context's heap now. Optional: every entry point
+// below initializes lazily on first use.
+void allocator_init();
+
 // Allocate a block of memory of the given size using the specified fit strategy.
 // Returns an integer handle that is the byte offset from the start of the heap,
 // or -1 on failure.
@@ -26,11 +42,160 @@ int allocator_malloc(std::size_t size, const std::string &strategy);
 // Backward-compatible default: first-fit strategy.
 int allocator_malloc(std::size_t size);
 
+// Change the global allocation strategy used by allocator_malloc(size).
+void allocator_set_strategy(FitStrategy strategy);
+
 // Free a previously allocated block identified by its handle (offset into heap).
 void allocator_free(int id);
 
+// Read from / write to an allocated block through the cache simulator.
+// Return false if the id/range is invalid or (reads only) if the range
+// contains bytes that look like uninitialized/freed ("garbage") data.
+bool allocator_read(int id, std::size_t offset, void *dst, std::size_t size);
+bool allocator_write(int id, std::size_t offset, const void *src, std::size_t size);
+
+// Set a block's cache placement hint. Allocations start as Normal;
+// Streaming marks a block's traffic non-temporal (uses resident lines but
+// never fills any), Uncacheable sends it straight to memory. The string
+// overload accepts "normal", "streaming"/"nt", "uncacheable"/"uc" and
+// returns false for an unknown name; the boolean form maps onto
+// Normal/Uncacheable.
+void allocator_set_block_hint(int id, AccessHint hint);
+bool allocator_set_block_hint(int id, const std::string &hint);
+void allocator_set_block_cacheable(int id, bool cacheable);
+
+// Simulate one access to a block through the cache hierarchy, honoring
+// the block's placement hint.
+void allocator_access(int id, bool is_write);
+
+// Resize a block, growing in place when the free physical successor is
+// large enough; otherwise the data is moved to a fresh block (with the
+// copy simulated as one ranged read + one ranged write through the cache).
+// Returns the possibly-changed id, or -1 on failure; new_size == 0 frees.
+int allocator_realloc(int id, std::size_t new_size);
+
+// Allocate with a caller-chosen power-of-two alignment (e.g. 64 for cache
+// lines, 4096 for pages). Alignments up to alignof(std::max_align_t) are
+// already guaranteed by allocator_malloc.
+int allocator_malloc_aligned(std::size_t size, std::size_t align, FitStrategy strategy);
+int allocator_malloc_aligned(std::size_t size, std::size_t align);
+
+// Enable/disable the uninitialized/freed debug fill patterns (default on).
+// With fills disabled, malloc/free skip their memsets and read/write skip
+// garbage detection — intended for throughput-oriented benchmark runs.
+void allocator_set_debug_fill(bool enabled);
+
+// Set the heap size used at (re)initialization. Only effective before the
+// first allocation or after allocator_reset(). The arena grows past this
+// automatically when an allocation cannot be satisfied.
+void allocator_set_heap_size(std::size_t bytes);
+
+// Set the number of heap shards for concurrent use (default 1, max 64).
+// Each shard has its own block list and lock; threads hash to a home
+// shard. Only effective before the first allocation or after reset.
+void allocator_set_shards(std::size_t shards);
+
+// Select the allocation engine: "list" (fit-strategy allocator, the
+// default) or "buddy" (binary buddy system: O(log n) split/merge,
+// power-of-two internal fragmentation). Both feed the same stats and
+// cache counters, so engines are directly comparable on one trace.
+// Only effective before the first allocation or after reset.
+void allocator_set_engine(const std::string &engine);
+
+// An independent allocator instance with its own heap, id space, stats and
+// cache hierarchy. Contexts share nothing, so several can run in parallel
+// (e.g. replaying one trace under every fit strategy at once). The classic
+// allocator_* functions above operate on a built-in default context.
+struct AllocatorContext;
+
+// Create a context with the given startup heap size and shard count.
+AllocatorContext *allocator_context_create(std::size_t heap_size, std::size_t shards);
+
+// Destroy a context and release its heap. Must not race with any use of
+// the same context.
+void allocator_context_destroy(AllocatorContext *ctx);
+
+// Context-based counterparts of the classic API.
+int allocator_ctx_malloc(AllocatorContext *ctx, std::size_t size, FitStrategy strategy);
+void allocator_ctx_free(AllocatorContext *ctx, int id);
+bool allocator_ctx_read(AllocatorContext *ctx, int id, std::size_t offset, void *dst, std::size_t size);
+bool allocator_ctx_write(AllocatorContext *ctx, int id, std::size_t offset, const void *src, std::size_t size);
+
+// Aggregate cache counters of a context's hierarchy.
+void allocator_ctx_cache_totals(AllocatorContext *ctx, std::uint64_t &accesses,
+                                std::uint64_t &hits, std::uint64_t &total_penalty);
+
+// One coherent reading of the allocator counters allocator_stats() prints,
+// for drivers that post-process them instead of parsing the text.
+struct AllocatorStatsSnapshot
+{
+	std::size_t heap_size;
+	std::size_t total_used;
+	std::size_t total_free;
+	std::size_t used_blocks;
+	std::size_t free_blocks;
+	std::size_t internal_frag_bytes;
+	std::size_t largest_free_block;
+	std::size_t alloc_requests;
+	std::size_t alloc_success;
+	std::size_t alloc_fail;
+	std::size_t small_cached_blocks;
+	std::size_t small_cached_bytes;
+	std::size_t small_hits;
+	std::size_t small_fills;
+	std::size_t small_flushes;
+	double utilization_pct;
+	double internal_frag_pct;
+	double external_frag_pct;
+};
+
+AllocatorStatsSnapshot allocator_collect_stats();
+AllocatorStatsSnapshot allocator_ctx_collect_stats(AllocatorContext *ctx);
+
+// Slide live blocks toward the start of the heap, rewriting their id
+// mappings, and merge the vacated space into one trailing free region.
+// Safe because user access goes through ids, never raw pointers; call at
+// quiescent points only. max_move_bytes bounds how much payload one call
+// copies (0 = unbounded) so repeated bounded calls converge without a
+// single long pause. Returns the number of bytes moved.
+std::size_t allocator_compact(std::size_t max_move_bytes = 0);
+
+// Full allocator + cache counters as one JSON object.
+std::string allocator_stats_json();
+
+// Couple or decouple the cache simulator from the allocator's read/write
+// path: "full" simulates every access (the default), "off" skips the
+// simulator entirely, and "sampled" feeds only every `interval`-th access
+// while scaling the reported counters by the interval, trading exactness
+// for throughput. Returns false for an unknown mode.
+bool allocator_set_cache_sim(const std::string &mode, std::size_t interval = 0);
+
+// Append one compact stats record (CSV or JSON lines) per `interval`
+// operations to `path`; interval 0 or a null path stops sampling, as does
+// allocator_stop_sampling(). Returns false if the file cannot be opened.
+bool allocator_set_sampling(const char *path, std::size_t interval, bool csv);
+void allocator_stop_sampling();
+
+// Checkpoint the default allocator (heap image, block metadata, counters)
+// and the global cache to a file, and resume from such a checkpoint.
+// In-heap pointers are rebased against the new mapping on restore.
+// Snapshot from quiescent points only: other threads' small-object caches
+// cannot be flushed from here.
+bool allocator_snapshot(const char *path);
+bool allocator_restore(const char *path);
+
+// Reset the default context (and global cache) to a pristine state.
+// Benchmark drivers use this to run several isolated workloads in one
+// process. Not thread-safe: no other thread may be using the allocator.
+void allocator_reset();
+
 // Dump the allocator's internal state to stdout.
 void allocator_dump();
 
 // Print basic allocator statistics (total used/free bytes and blocks).
 void allocator_stats();
+
+// Reset the per-operation host-timing histograms that allocator_stats()
+// prints (count/mean/p99/max for malloc, free, read, write and cache
+// accesses). Timing stays enabled; only the samples are cleared.
+void allocator_reset_timing();
@@ -0,0 +1,558 @@
+// cache.hpp
+// Public API for the multi-level cache simulator implemented in
+// src/cache.cpp: configurable levels (size/block/associativity/latency),
+// replacement and write policies, prefetchers, an optional TLB stage and
+// a multi-core topology with MESI-style coherence. The classic cache_*
+// functions operate on one process-wide hierarchy; embedders can also
+// instantiate MultiLevelCache directly for independent instances.
+
+#pragma once
+
+#include <cstddef> // std::size_t
+#include <cstdint> // std::uint64_t, std::uintptr_t
+#include <cstdio>  // std::FILE
+#include <iosfwd>  // std::ostream
+#include <mutex>   // std::mutex
+#include <string>  // std::string
+#include <vector>  // std::vector
+
+// Hardware-prefetcher model, triggered from a level's demand-miss path.
+// NextLine fetches the following `degree` lines; Stride watches the miss
+// address delta and fetches ahead only once the same stride repeats.
+enum class PrefetchPolicy
+{
+	None,
+	NextLine,
+	Stride,
+};
+
+const char *prefetch_policy_name(PrefetchPolicy policy);
+
+// Victim selection within a set. LFU (the historical default) keeps the
+// LRU tie-break; TreePLRU uses the classic binary-tree pseudo-LRU bits
+// and falls back to true LRU when the associativity is not a power of
+// two (the tree only encodes power-of-two fanouts).
+enum class ReplacementPolicy
+{
+	LFU,
+	LRU,
+	FIFO,
+	Random,
+	TreePLRU,
+};
+
+const char *replacement_policy_name(ReplacementPolicy policy);
+
+// Per-level write handling. Write-back marks lines dirty and pays for the
+// propagation only when a dirty line is evicted; write-through pays the
+// next level's latency on every write hit. Write-allocate fills the line
+// on a write miss; no-allocate lets write misses bypass the level.
+enum class WritePolicy
+{
+	WriteThrough,
+	WriteBack,
+};
+
+enum class AllocatePolicy
+{
+	WriteAllocate,
+	NoWriteAllocate,
+};
+
+// Per-access placement hint, supplied by the caller (the allocator keeps
+// one per block). Normal uses the full hierarchy; Streaming models
+// non-temporal accesses that use a line if it is already resident but
+// never fill one in, so a streaming pass cannot evict the working set;
+// Uncacheable goes straight to memory and touches no lines at all.
+enum class AccessHint
+{
+	Normal = 0,
+	Streaming = 1,
+	Uncacheable = 2,
+};
+
+const char *access_hint_name(AccessHint hint);
+
+struct CacheLevelStats
+{
+	std::uint64_t accesses = 0;
+	std::uint64_t hits = 0;
+	std::uint64_t misses = 0;
+	std::uint64_t miss_penalty_accum = 0; // Extra penalty due to going to lower levels.
+	std::uint64_t writebacks = 0;     // dirty lines evicted (write-back)
+	std::uint64_t write_throughs = 0; // write hits propagated down (write-through)
+	std::uint64_t prefetch_issued = 0; // lines brought in by the prefetcher
+	std::uint64_t prefetch_useful = 0; // prefetched lines later hit by demand
+};
+
+// One cache level. Per-line state lives in structure-of-arrays form: one
+// contiguous array per field, indexed by set_idx * associativity + way,
+// with the valid/dirty/prefetched flags packed into bitmaps. A set scan
+// in access()/insert() then walks sequential words instead of chasing a
+// vector-of-vectors, which matters because the simulator spends most of a
+// replay inside those two functions.
+class CacheLevel
+{
+public:
+	CacheLevel(std::size_t size_bytes,
+	           std::size_t block_size,
+	           std::size_t associativity,
+	           std::size_t access_latency_cycles,
+	           std::size_t level_index,
+	           ReplacementPolicy replacement = ReplacementPolicy::LFU);
+
+	std::size_t latency() const { return m_latency; }
+	std::size_t level_index() const { return m_level_index; }
+
+	WritePolicy write_policy() const { return m_write_policy; }
+	AllocatePolicy allocate_policy() const { return m_allocate_policy; }
+	void set_write_policy(WritePolicy policy) { m_write_policy = policy; }
+	void set_allocate_policy(AllocatePolicy policy) { m_allocate_policy = policy; }
+	ReplacementPolicy replacement_policy() const { return m_replacement; }
+
+	const CacheLevelStats &stats() const { return m_stats; }
+	CacheLevelStats &stats() { return m_stats; }
+
+	std::size_t size_bytes() const { return m_size_bytes; }
+	std::size_t block_size() const { return m_block_size; }
+	std::size_t associativity() const { return m_associativity; }
+	std::size_t num_sets() const { return m_num_sets; }
+
+	// Serialize/deserialize the mutable per-line state (geometry and
+	// policies travel separately so load can reconstruct the level first).
+	bool save_state(std::FILE *fp) const;
+	bool load_state(std::FILE *fp);
+
+	// Re-file every resident line as if the memory it caches moved by
+	// `delta` bytes. Tags encode absolute host addresses, so restored
+	// state is useless (and can falsely hit) once the arena is mapped at
+	// a new base; see allocator_restore.
+	void rebase(std::intptr_t delta);
+
+	// Lookup an address. Returns true on hit and updates LFU/LRU data.
+	// A write hit under write-back marks the line dirty; under
+	// write-through the line stays clean (the caller pays to propagate).
+	bool access(std::uintptr_t addr, std::uint64_t timestamp, bool is_write);
+
+	// Insert (or update) a line corresponding to addr using LFU replacement.
+	// Sets evicted_dirty when a valid dirty line had to be displaced, so
+	// the controller can charge the write-back cost.
+	void insert(std::uintptr_t addr, std::uint64_t timestamp, bool is_write, bool &evicted_dirty);
+
+	// Non-mutating residence probe for the coherence controller: -1 when the
+	// line is absent, 0 when resident and clean, 1 when resident and dirty.
+	// No stats or replacement metadata are touched.
+	int residency(std::uintptr_t addr) const;
+
+	// Drop the line holding addr (MESI invalidation on a remote write).
+	// Returns -1 when absent, 0 when a clean line was dropped, 1 when the
+	// line was dirty — the caller charges the flush.
+	int invalidate(std::uintptr_t addr);
+
+	// Clear the dirty bit of a resident line (MESI downgrade, M -> S, on a
+	// remote read); the write-back cost is charged by the caller.
+	void downgrade(std::uintptr_t addr);
+
+	// Prefetch the line holding addr if it is absent. Off the critical
+	// path: no latency is charged, but dirty evictions it forces are
+	// still counted.
+	void prefetch(std::uintptr_t addr, std::uint64_t timestamp);
+
+	// Feed the prefetcher with a demand-miss address; may issue up to
+	// `degree` line fills into this level.
+	void prefetch_after_miss(std::uintptr_t addr, std::uint64_t timestamp);
+
+	void set_prefetcher(PrefetchPolicy policy, std::size_t degree);
+
+	PrefetchPolicy prefetch_policy() const { return m_prefetch; }
+	std::size_t prefetch_degree() const { return m_prefetch_degree; }
+
+	// Weight applied to this level's counters; >1 when only a sampled
+	// subset of accesses is simulated, so reported totals stay estimates
+	// of the full stream.
+	void set_stat_scale(std::size_t scale) { m_stat_scale = scale ? scale : 1; }
+	std::size_t stat_scale() const { return m_stat_scale; }
+
+private:
+	// Tag stored in lines that hold nothing, so the hot-path scan can
+	// compare tags without consulting the valid bitmap per way.
+	static constexpr std::uintptr_t TAG_NONE = ~static_cast<std::uintptr_t>(0);
+
+	void compute_index_tag(std::uintptr_t addr, std::size_t &set_idx, std::uintptr_t &tag) const;
+
+	static bool bitmap_test(const std::vector<std::uint64_t> &bits, std::size_t line)
+	{
+		return (bits[line >> 6] >> (line & 63)) & 1u;
+	}
+
+	static void bitmap_set(std::vector<std::uint64_t> &bits, std::size_t line, bool value)
+	{
+		if (value)
+			bits[line >> 6] |= 1ull << (line & 63);
+		else
+			bits[line >> 6] &= ~(1ull << (line & 63));
+	}
+
+	template <typename T>
+	static bool write_array(std::FILE *fp, const std::vector<T> &v)
+	{
+		return std::fwrite(v.data(), sizeof(T), v.size(), fp) == v.size();
+	}
+
+	template <typename T>
+	static bool read_array(std::FILE *fp, std::vector<T> &v)
+	{
+		return std::fread(v.data(), sizeof(T), v.size(), fp) == v.size();
+	}
+
+	std::size_t find_tag(std::size_t base, std::uintptr_t tag) const;
+	void fill_line(std::size_t set_idx, std::uintptr_t tag, std::uint64_t timestamp,
+	               bool fill_dirty, bool prefetched, bool &evicted_dirty);
+	void plru_touch(std::size_t set_idx, std::size_t way);
+	std::size_t plru_victim(std::size_t set_idx) const;
+	std::size_t select_victim(std::size_t set_idx);
+
+private:
+	std::size_t m_size_bytes;
+	std::size_t m_block_size;
+	std::size_t m_associativity;
+	std::size_t m_latency;      // cycles per access at this level
+	std::size_t m_num_sets;
+	bool m_pow2_geometry = false; // block size and set count are powers of two
+	std::size_t m_block_shift = 0;
+	std::size_t m_set_shift = 0;
+	std::size_t m_level_index;  // 0 for L1, 1 for L2, ...
+	WritePolicy m_write_policy = WritePolicy::WriteBack;
+	AllocatePolicy m_allocate_policy = AllocatePolicy::WriteAllocate;
+	ReplacementPolicy m_replacement = ReplacementPolicy::LFU;
+	std::uint64_t m_rng_state = 0x9E3779B97F4A7C15ull; // for Random replacement
+
+	PrefetchPolicy m_prefetch = PrefetchPolicy::None;
+	std::size_t m_prefetch_degree = 1;
+	std::size_t m_stat_scale = 1; // counter weight under sampled simulation
+	std::uintptr_t m_stride_last_block = ~static_cast<std::uintptr_t>(0);
+	std::intptr_t m_stride_last_delta = 0;
+
+	// One bit tree per set; empty unless the policy is TreePLRU.
+	std::vector<std::vector<std::uint8_t>> m_plru_bits;
+
+	// Line state in SoA form, indexed by set_idx * m_associativity + way.
+	// Flags are 1-bit-per-line bitmaps; the rest are flat per-field arrays.
+	std::vector<std::uint64_t> m_valid;
+	std::vector<std::uint64_t> m_dirty;
+	std::vector<std::uint64_t> m_prefetched;
+	std::vector<std::uintptr_t> m_tags;
+	std::vector<std::uint64_t> m_freq;
+	std::vector<std::uint64_t> m_last_used;
+	std::vector<std::uint64_t> m_inserted;
+
+	// Incremental victim metadata: valid ways per set (fills never scan
+	// for a free way) and the round-robin FIFO eviction cursor.
+	std::vector<std::uint16_t> m_fill_count;
+	std::vector<std::uint16_t> m_fifo_cursor;
+
+	CacheLevelStats m_stats;
+};
+
+struct TlbStats
+{
+	std::uint64_t accesses = 0;
+	std::uint64_t hits = 0;
+	std::uint64_t misses = 0;
+	std::uint64_t walk_cycles = 0; // total page-walk penalty paid
+};
+
+// Counters for the MESI-style invalidation model in multi-core topology
+// mode (private levels per core over one shared last level).
+struct CoherenceStats
+{
+	std::uint64_t invalidations = 0;     // peer private lines dropped by writes
+	std::uint64_t inval_writebacks = 0;  // dropped lines that were dirty (flushed)
+	std::uint64_t coherence_misses = 0;  // private misses served from a peer cache
+	std::uint64_t dirty_transfers = 0;   // coherence misses where the copy was dirty
+};
+
+// A full hierarchy: an ordered list of levels, main memory behind them, an
+// optional TLB stage in front and an optional multi-core topology where
+// every level but the last is replicated per core.
+class MultiLevelCache
+{
+public:
+	MultiLevelCache() = default;
+
+	void reset();
+
+	void set_memory_latency(std::size_t latency_cycles)
+	{
+		m_memory_latency = latency_cycles ? latency_cycles : 1;
+	}
+
+	// Sampled-simulation support: when the caller feeds only every Nth
+	// access into the hierarchy, set the scale to N and every counter
+	// increment is weighted so the reported totals remain estimates of
+	// the full access stream.
+	void set_sample_scale(std::size_t scale);
+
+	std::size_t sample_scale() const { return m_sample_scale; }
+
+	// Append a new cache level (L1 is index 0, L2 is 1, ...).
+	void add_level(std::size_t size_bytes,
+	              std::size_t block_size,
+	              std::size_t associativity,
+	              std::size_t access_latency_cycles,
+	              ReplacementPolicy replacement = ReplacementPolicy::LFU);
+
+	std::size_t level_count() const
+	{
+		return m_levels.size();
+	}
+
+	// Multi-core topology: with cores > 1, every level except the last
+	// becomes a per-core private replica (cloned from the configured level's
+	// geometry and policies) and the last level is shared by all cores.
+	// Needs at least two levels; with one level the hierarchy stays flat.
+	// Switching core counts discards private contents and coherence stats.
+	void set_cores(std::size_t cores);
+
+	std::size_t cores() const { return m_num_cores; }
+	const CoherenceStats &coherence_stats() const { return m_coherence; }
+
+	// Aggregate counters, for callers that need numbers rather than text.
+	std::uint64_t total_accesses() const { return m_total_accesses; }
+	std::uint64_t total_hits() const { return m_total_hits; }
+	std::uint64_t total_misses() const { return m_total_misses; }
+	std::uint64_t total_penalty() const { return m_total_penalty; }
+
+	// Configure the address-translation stage: a set-associative TLB of
+	// `entries` page mappings with a fixed page-walk penalty on miss.
+	// entries == 0 disables translation modeling. Internally the TLB is a
+	// CacheLevel whose "block" is one page, replaced with true LRU.
+	void configure_tlb(std::size_t entries, std::size_t page_size,
+	                   std::size_t associativity, std::size_t walk_penalty_cycles);
+
+	// Huge-page mode: rebuild the TLB with 2 MB (or back to 4 KB) pages,
+	// keeping entry count, associativity and walk penalty. Far fewer pages
+	// cover the same footprint, so the same TLB maps a much larger range.
+	void set_huge_pages(bool enabled);
+
+	bool tlb_enabled() const { return m_tlb_enabled; }
+	std::size_t tlb_page_size() const { return m_tlb_page_size; }
+	const TlbStats &tlb_stats() const { return m_tlb_stats; }
+
+	void configure_level(std::size_t level_index,
+	                     std::size_t size_bytes,
+	                     std::size_t block_size,
+	                     std::size_t associativity,
+	                     std::size_t access_latency_cycles);
+
+	void configure_level(std::size_t level_index,
+	                     std::size_t size_bytes,
+	                     std::size_t block_size,
+	                     std::size_t associativity,
+	                     std::size_t access_latency_cycles,
+	                     ReplacementPolicy replacement);
+
+	void set_write_policy(std::size_t level_index, WritePolicy write_policy,
+	                      AllocatePolicy allocate_policy);
+
+	void set_prefetcher(std::size_t level_index, PrefetchPolicy policy, std::size_t degree);
+
+	// Perform a read/write access and update statistics.
+	// The access is address-based; allocator/main can choose any
+	// scheme for mapping its ids/offsets to an address. `core` selects the
+	// private level stack in topology mode and is ignored otherwise;
+	// `hint` lets non-temporal and uncached traffic bypass the hierarchy.
+	void access(std::uintptr_t addr, bool is_write, std::size_t core = 0,
+	            AccessHint hint = AccessHint::Normal);
+
+	// Access a byte range by decomposing it into cache-block-granular
+	// accesses: one access per block the range covers, at the finest block
+	// size across all levels. A 4 KB copy thus costs 64 pipeline walks
+	// instead of 4096 per-byte ones while touching the same set of lines.
+	void access_range(std::uintptr_t addr, std::size_t len, bool is_write, std::size_t core = 0,
+	                  AccessHint hint = AccessHint::Normal);
+
+	// Serialize the whole hierarchy (geometry, policies, counters and every
+	// line) so a checkpointed run can resume with identical cache behavior.
+	bool save(std::FILE *fp) const;
+	bool load(std::FILE *fp);
+
+	// Re-file every resident line — across all levels, the per-core
+	// private replicas and the TLB — as if the cached memory moved by
+	// `delta` bytes (the arena lands at a new base on restore).
+	void rebase(std::intptr_t delta);
+
+	// Machine-readable exports: the same counters dump_stats() prints,
+	// as a JSON object or as comma-separated fields for sampling files.
+	void write_json(std::ostream &os) const;
+	void write_csv_header(std::ostream &os) const;
+	void write_csv_fields(std::ostream &os) const;
+
+	void dump_stats(std::ostream &os) const;
+
+private:
+	// One level's configuration and counters, shared between the flat and
+	// the per-core listing in dump_stats().
+	static void dump_level(std::ostream &os, const std::string &label, const CacheLevel &lvl);
+
+	// Counters for level i as one row: the level's own stats in the flat
+	// hierarchy, or the sum over every core's replica for a private level
+	// in topology mode (the shared last level is never replicated).
+	CacheLevelStats level_totals(std::size_t i) const;
+
+	// Cost of pushing data one level further down the walked stack: the
+	// next level's latency, or main memory past the last level.
+	std::size_t stack_downstream(CacheLevel *const *stack, std::size_t depth,
+	                             std::size_t level_index) const;
+
+	// (Re)create the per-core private replicas from the configured levels.
+	// Called whenever the core count or a level's configuration changes, so
+	// private contents and coherence counters start fresh. With one core or
+	// fewer than two levels the hierarchy stays flat.
+	void rebuild_private();
+
+private:
+	// Deepest stack access() can walk; far above any realistic hierarchy.
+	static constexpr std::size_t MAX_WALK_LEVELS = 16;
+
+	std::vector<CacheLevel> m_levels;
+	std::size_t m_memory_latency = 100; // cycles to access main memory
+	std::uint64_t m_timestamp = 0;      // global logical time for LRU tie-breaks
+
+	std::uint64_t m_total_accesses = 0;
+	std::uint64_t m_total_hits = 0;   // hit in any cache level
+	std::uint64_t m_total_misses = 0; // went to main memory
+	std::uint64_t m_total_penalty = 0; // total cycles for all accesses
+	std::size_t m_sample_scale = 1;    // counter weight under sampled simulation
+
+	// Address-translation stage (disabled unless configured).
+	std::vector<CacheLevel> m_tlb; // 0 or 1 entries
+	bool m_tlb_enabled = false;
+	std::size_t m_tlb_entries = 0;
+	std::size_t m_tlb_page_size = 4096;
+	std::size_t m_tlb_assoc = 0;
+	std::size_t m_page_walk_penalty = 50;
+	TlbStats m_tlb_stats;
+
+	// Multi-core topology (flat single-core hierarchy unless cores > 1).
+	// m_private[c] holds core c's replicas of all levels but the last;
+	// m_levels keeps the configuration prototypes and the shared last level.
+	std::size_t m_num_cores = 1;
+	std::vector<std::vector<CacheLevel>> m_private;
+	CoherenceStats m_coherence;
+
+	// Hinted-traffic counters (weighted like every other counter).
+	std::uint64_t m_streaming_accesses = 0;
+	std::uint64_t m_uncacheable_accesses = 0;
+};
+
+// ------------------------ Global cache API ------------------------ //
+//
+// The classic cache_* functions below operate on one process-wide
+// hierarchy (the one the allocator's default context simulates through
+// and cache_menu_loop() configures).
+
+// The global hierarchy and the mutex that serializes concurrent
+// allocator threads' accesses to it, so LFU/LRU metadata and the stats
+// counters stay consistent. Most callers should go through the
+// functions below instead of touching these directly.
+extern MultiLevelCache g_cache;
+extern std::mutex g_cache_lock;
+
+// Configure a cache instance with the two default levels (L1, L2).
+// Shared between the global cache and per-context instances.
+void cache_setup_default_levels(MultiLevelCache &cache);
+
+// Initialize the global cache with the default levels.
+// Users can instead call cache_reset() + cache_add_level() manually.
+void cache_init_default();
+
+void cache_reset();
+
+void cache_add_level(std::size_t size_bytes,
+	                 std::size_t block_size,
+	                 std::size_t associativity,
+	                 std::size_t access_latency_cycles,
+	                 ReplacementPolicy replacement = ReplacementPolicy::LFU);
+
+void cache_configure_level(std::size_t level_index,
+	                        std::size_t size_bytes,
+	                        std::size_t block_size,
+	                        std::size_t associativity,
+	                        std::size_t access_latency_cycles);
+
+void cache_configure_level(std::size_t level_index,
+	                        std::size_t size_bytes,
+	                        std::size_t block_size,
+	                        std::size_t associativity,
+	                        std::size_t access_latency_cycles,
+	                        ReplacementPolicy replacement);
+
+std::size_t cache_get_level_count();
+
+// Set a level's write and allocate policies (defaults: write-back,
+// write-allocate).
+void cache_set_write_policy(std::size_t level_index, WritePolicy write_policy,
+	                         AllocatePolicy allocate_policy);
+
+void cache_set_memory_latency(std::size_t latency_cycles);
+
+// Configure the TLB stage (entries == 0 disables it).
+void cache_configure_tlb(std::size_t entries, std::size_t page_size,
+	                      std::size_t associativity, std::size_t walk_penalty_cycles);
+
+// Switch the TLB between 2 MB huge pages and 4 KB base pages.
+void cache_set_huge_pages(bool enabled);
+
+// Attach (or remove, with PrefetchPolicy::None) a level's prefetcher.
+void cache_set_prefetcher(std::size_t level_index, PrefetchPolicy policy, std::size_t degree);
+
+// Weight every counter increment by `scale` (used by the allocator's
+// sampled simulation mode, where only every Nth access reaches us).
+void cache_set_sample_scale(std::size_t scale);
+
+// Select the core topology: 1 keeps the flat single-core hierarchy; with
+// more cores every level but the last becomes a per-core private replica
+// over one shared last level, with MESI-style invalidation between the
+// private copies. Changing the count discards private cache contents.
+void cache_set_cores(std::size_t cores);
+
+std::size_t cache_get_cores();
+
+// Perform a cache access. The address can be any value the caller
+// wishes to use (e.g., g_heap offset, BlockHeader::id, or a pointer).
+// `core` identifies the issuing core in topology mode (any value is
+// reduced modulo the core count) and is ignored on a single-core setup;
+// `hint` routes non-temporal/uncached traffic around the hierarchy.
+void cache_access(std::uintptr_t addr, bool is_write, std::size_t core = 0,
+                  AccessHint hint = AccessHint::Normal);
+
+// Ranged variant: simulates [addr, addr + len) at cache-block granularity.
+void cache_access_range(std::uintptr_t addr, std::size_t len, bool is_write,
+                        std::size_t core = 0, AccessHint hint = AccessHint::Normal);
+
+// Serialize/deserialize the global cache to an already-open stream
+// (used by the allocator's snapshot/restore files).
+bool cache_save(std::FILE *fp);
+bool cache_load(std::FILE *fp);
+
+// Re-file the global cache's resident lines after the heap arena moved;
+// restore calls this with the same delta it rebases block pointers by, so
+// lines hot at the checkpoint keep hitting under the new mapping.
+void cache_rebase(std::intptr_t delta);
+
+// Machine-readable counterparts of cache_dump_stats().
+void cache_write_json(std::ostream &os);
+void cache_write_csv_header(std::ostream &os);
+void cache_write_csv_fields(std::ostream &os);
+
+// Print cache statistics to std::cout.
+void cache_dump_stats();
+
+// Parse policy names for config files and scripts. Both return false
+// for an unknown name, leaving `out` untouched.
+bool replacement_policy_from_name(const std::string &name, ReplacementPolicy &out);
+bool prefetch_policy_from_name(const std::string &name, PrefetchPolicy &out);
+
+// Interactive cache configuration and testing menu.
+void cache_menu_loop();
@@ -1,471 +1,2702 @@
-
-// Custom memory allocator implementation.
-// Designed to be used by an external CLI/test harness (e.g., mainn.cpp).
-
-#include <cstddef>
-#include <cstdint>
-#include <cstring>
-#include <string>
-#include "cache.cpp"
-
-// Cache API provided by cache.cpp
-void cache_init_default();
-void cache_reset();
-void cache_add_level(std::size_t size_bytes,
-	                 std::size_t block_size,
-	                 std::size_t associativity,
-	                 std::size_t access_latency_cycles);
-void cache_set_memory_latency(std::size_t latency_cycles);
-void cache_access(std::uintptr_t addr, bool is_write);
-void cache_dump_stats();
-
-// Simple fixed-size heap for the custom allocator.
-extern std::size_t HEAP_SIZE;
-extern std::uint8_t g_heap[];
-
-// Header that lives at the beginning of each block inside g_heap.
-// [BlockHeader][user bytes ...]
-struct BlockHeader
-{
-	int id;                      // Unique identifier for the block.
-	std::uint8_t *start;         // Start address of the user area.
-	std::size_t size;            // Size of the user area in bytes (actual allocated size).
-	std::size_t requested_size;  // Size originally requested by the user.
-	bool free;                   // Whether this block is free or allocated.
-	bool cacheable;              // Whether this block is cacheable.
-	std::size_t cache_hits;      // Number of times this block was accessed from cache.
-	BlockHeader *next;           // Next block in the list.
-};
-
-static BlockHeader *g_head = nullptr; // Head of the block list.
-static int g_next_id = 0;             // Monotonically increasing id for allocated blocks.
-static bool g_cache_initialized = false; // Tracks cache initialization.
-
-// Simple allocation statistics.
-static std::size_t g_alloc_requests = 0; // Number of allocation attempts.
-static std::size_t g_alloc_success  = 0; // Number of successful allocations.
-static std::size_t g_alloc_fail     = 0; // Number of failed allocations.
-
-// Patterns used to detect uninitialized / freed memory accesses.
-static constexpr std::uint8_t PATTERN_UNINITIALIZED = 0xCD;
-static constexpr std::uint8_t PATTERN_FREED         = 0xDD;
-
-enum class FitStrategy
-{
-    First,
-	Best,
-	Worst,
-};
-
-static FitStrategy g_current_strategy = FitStrategy::First; // Global allocation strategy.
-
-FitStrategy parse_strategy(std::string s)
-{
-	// Accept common spellings.
-	if (s == "first" || s == "first_fit" || s == "first-fit" || s == "firstfit")
-		return FitStrategy::First;
-	if (s == "best" || s == "best_fit" || s == "best-fit" || s == "bestfit")
-		return FitStrategy::Best;
-	if (s == "worst" || s == "worst_fit" || s == "worst-fit" || s == "worstfit")
-		return FitStrategy::Worst;
-	return FitStrategy::First;
-}
-
-static void allocator_init()
-{
-	if (g_head)
-		return; // already initialized
-
-	if (!g_cache_initialized)
-	{
-		cache_init_default();
-		g_cache_initialized = true;
-	}
-
-	// Create a single big free block that spans the whole heap.
-	g_head = reinterpret_cast<BlockHeader *>(g_heap);
-	g_head->id = -1;
-	g_head->start = reinterpret_cast<std::uint8_t *>(g_head) + sizeof(BlockHeader);
-	g_head->size = HEAP_SIZE - sizeof(BlockHeader);
-	g_head->requested_size = 0;
-	g_head->free = true;
-	g_head->cacheable = false;
-	g_head->cache_hits = 0;
-	g_head->next = nullptr;
-}
-
-static std::size_t align_size(std::size_t size)
-{
-	const std::size_t align = alignof(std::max_align_t);
-	return (size + align - 1) & ~(align - 1);
-}
-
-static BlockHeader *find_fit(BlockHeader *head, std::size_t size, FitStrategy strategy)
-{
-	BlockHeader *candidate = nullptr;
-
-	for (BlockHeader *curr = head; curr; curr = curr->next)
-	{
-		if (!curr->free || curr->size < size)
-			continue;
-
-		if (strategy == FitStrategy::First)
-			return curr;
-
-		if (!candidate)
-		{
-			candidate = curr;
-			continue;
-		}
-
-		if (strategy == FitStrategy::Best)
-		{
-			if (curr->size < candidate->size)
-				candidate = curr;
-		}
-		else // Worst
-		{
-			if (curr->size > candidate->size)
-				candidate = curr;
-		}
-	}
-
-	return candidate;
-}
-
-static BlockHeader *find_block_by_id(int id)
-{
-	BlockHeader *hdr = g_head;
-	while (hdr)
-	{
-		if (!hdr->free && hdr->id == id)
-			return hdr;
-		hdr = hdr->next;
-	}
-	return nullptr;
-}
-
-static void split_block_if_needed(BlockHeader *block, std::size_t size)
-{
-	// Assumes block is free and block->size >= size.
-	std::size_t remaining = block->size - size;
-	// Only split if there's enough space to hold a new header and some payload.
-	if (remaining <= sizeof(BlockHeader) + 8)
-		return;
-
-	std::uint8_t *base = reinterpret_cast<std::uint8_t *>(block);
-	BlockHeader *new_block = reinterpret_cast<BlockHeader *>(base + sizeof(BlockHeader) + size);
-
-	new_block->id = -1;
-	new_block->start = reinterpret_cast<std::uint8_t *>(new_block) + sizeof(BlockHeader);
-	new_block->size = remaining - sizeof(BlockHeader);
-	new_block->requested_size = 0;
-	new_block->free = true;
-	new_block->cacheable = false;
-	new_block->cache_hits = 0;
-	new_block->next = block->next;
-
-	block->size = size;
-	block->next = new_block;
-}
-
-static void coalesce_free_blocks()
-{
-	BlockHeader *curr = g_head;
-	while (curr)
-	{
-		BlockHeader *next = curr->next;
-		if (next && curr->free && next->free)
-		{
-			std::uint8_t *curr_end = reinterpret_cast<std::uint8_t *>(curr) + sizeof(BlockHeader) + curr->size;
-			if (curr_end == reinterpret_cast<std::uint8_t *>(next))
-			{
-				curr->size += sizeof(BlockHeader) + next->size;
-				curr->requested_size = 0;
-				curr->next = next->next;
-				continue; // attempt to merge with the new curr->next again
-			}
-		}
-		curr = curr->next;
-	}
-}
-
-// Allocate a block of memory of given size using a fit strategy.
-// Returns an integer handle that is the byte offset from the start of the heap.
-int allocator_malloc(std::size_t size, FitStrategy strategy)
-{
-	allocator_init();
-	if (size == 0)
-		return -1;
-
-	// Track allocation attempts for statistics.
-	++g_alloc_requests;
-	std::size_t requested_size = size;
-	std::size_t aligned_size = align_size(size);
-
-	BlockHeader *block = find_fit(g_head, aligned_size, strategy);
-	if (!block)
-	{
-		++g_alloc_fail;
-		return -1; // out of memory
-	}
-
-	split_block_if_needed(block, aligned_size);
-
-	block->free = false;
-	block->id = g_next_id++;
-	block->cacheable = true;
-	block->cache_hits = 0;
-	block->start = reinterpret_cast<std::uint8_t *>(block) + sizeof(BlockHeader);
-	block->requested_size = requested_size;
-	// Mark the entire allocated region as uninitialized.
-	std::memset(block->start, PATTERN_UNINITIALIZED, block->size);
-	++g_alloc_success;
-
-	std::ptrdiff_t offset = block->start - g_heap;
-	if (offset < 0 || static_cast<std::size_t>(offset) >= HEAP_SIZE)
-		return -1;
-
-	return block->id;
-}
-
-// Convenience overload: strategy as a string ("first", "best", "worst").
-int allocator_malloc(std::size_t size, std::string strategy)
-{
-    FitStrategy strat = parse_strategy(strategy);
-	return allocator_malloc(size, strat);
-}
-
-// Backward-compatible default: first-fit.
-int allocator_malloc(std::size_t size)
-{
-	return allocator_malloc(size, g_current_strategy);
-}
-
-// Change the global allocation strategy used by allocator_malloc(size).
-void allocator_set_strategy(FitStrategy strategy)
-{
-	g_current_strategy = strategy;
-}
-
-// Free a previously allocated block identified by id (offset into heap).
-void allocator_free(int id)
-{
-	allocator_init();
-	if (id < 0)
-		return; // invalid id
-
-	BlockHeader *hdr = find_block_by_id(id);
-	if (!hdr)
-		return; // not found or already free
-
-	hdr->free = true;
-	hdr->id = -1;
-	hdr->cacheable = false;
-	hdr->cache_hits = 0;
-	// Mark freed memory with a distinct pattern.
-	std::memset(hdr->start, PATTERN_FREED, hdr->size);
-
-	coalesce_free_blocks();
-}
-
-// Mark a block as cacheable or not.
-void allocator_set_block_cacheable(int id, bool cacheable)
-{
-	allocator_init();
-	if (id < 0)
-		return;
-	BlockHeader *hdr = find_block_by_id(id);
-	if (!hdr)
-		return;
-	hdr->cacheable = cacheable;
-}
-
-// Simulate an access to a block through the cache hierarchy.
-void allocator_access(int id, bool is_write)
-{
-	allocator_init();
-	if (id < 0)
-		return;
-	BlockHeader *hdr = find_block_by_id(id);
-	if (!hdr || !hdr->cacheable)
-		return;
-	cache_access(reinterpret_cast<std::uintptr_t>(hdr->start), is_write);
-	++hdr->cache_hits;
-}
-
-// Read from an allocated block into user-provided buffer.
-// Returns false if the id/range is invalid or if the range contains
-// bytes that look like uninitialized/freed ("garbage") data.
-bool allocator_read(int id, std::size_t offset, void *dst, std::size_t size)
-{
-	allocator_init();
-	if (id < 0 || !dst || size == 0)
-		return false;
-
-	BlockHeader *hdr = find_block_by_id(id);
-	if (!hdr || hdr->free)
-		return false;
-
-	if (offset + size > hdr->requested_size)
-		return false; // out of user-requested bounds
-
-	auto *src_bytes = hdr->start + offset;
-	auto *dst_bytes = static_cast<std::uint8_t *>(dst);
-	bool has_garbage = false;
-
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		std::uint8_t value = src_bytes[i];
-		// Simulate cache access for this byte.
-		cache_access(reinterpret_cast<std::uintptr_t>(src_bytes + i), false);
-		if (value == PATTERN_UNINITIALIZED || value == PATTERN_FREED)
-			has_garbage = true;
-		dst_bytes[i] = value;
-	}
-
-	if (has_garbage)
-		return false;
-	return true;
-}
-
-// Write to an allocated block from user-provided buffer.
-// Returns false if the id/range is invalid or if the destination range
-// currently contains bytes that look like uninitialized/freed
-// ("garbage") data.
-bool allocator_write(int id, std::size_t offset, const void *src, std::size_t size)
-{
-	allocator_init();
-	if (id < 0 || !src || size == 0)
-		return false;
-
-	BlockHeader *hdr = find_block_by_id(id);
-	if (!hdr || hdr->free)
-		return false;
-
-	if (offset + size > hdr->requested_size)
-		return false; // out of user-requested bounds
-
-	auto *dst_bytes = hdr->start + offset;
-	auto *src_bytes = static_cast<const std::uint8_t *>(src);
-	bool has_garbage = false;
-
-	// First pass: check for uninitialized/freed bytes without modifying memory.
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		std::uint8_t old_value = dst_bytes[i];
-		if (old_value == PATTERN_UNINITIALIZED || old_value == PATTERN_FREED)
-		{
-			has_garbage = true;
-			break;
-		}
-	}
-
-	// if (has_garbage)
-	// 	return false;
-
-	// Second pass: perform the actual write and simulate cache accesses.
-	for (std::size_t i = 0; i < size; ++i)
-	{
-		// Simulate cache access for this byte.
-		cache_access(reinterpret_cast<std::uintptr_t>(dst_bytes + i), true);
-		dst_bytes[i] = src_bytes[i];
-	}
-
-	return true;
-}
-
-// Dump allocator state to stdout.
-// NOTE: mainn.cpp can provide the printing; this exists for parity with the sample.
-#include <iostream>
-void allocator_dump()
-{
-	allocator_init();
-	std::cout << "Heap dump (block list):\n";
-	BlockHeader *curr = g_head;
-	std::size_t index = 0;
-	while (curr)
-	{
-		std::uint8_t *base = reinterpret_cast<std::uint8_t *>(curr);
-		std::size_t offset = static_cast<std::size_t>(base - g_heap);
-		std::cout << "  Block " << index++
-				  << ": offset=" << offset
-				  << ", id=" << curr->id
-				  << ", start=" << static_cast<void *>(curr->start)
-				  << ", size=" << curr->size
-				  << ", " << (curr->free ? "FREE" : "USED")
-				  << ", cacheable=" << (curr->cacheable ? "yes" : "no")
-				  << ", cache_hits=" << curr->cache_hits
-				  << "\n";
-		curr = curr->next;
-	}
-
-    std :: cout << sizeof(BlockHeader) << " bytes per block header\n";
-}
-
-void allocator_stats()
-{
-	allocator_init();
-	std::size_t total_free = 0;
-	std::size_t total_used = 0;
-	std::size_t free_blocks = 0;
-	std::size_t used_blocks = 0;
-	std::size_t internal_frag_bytes = 0;
-	std::size_t largest_free_block = 0;
-
-	for (BlockHeader *curr = g_head; curr; curr = curr->next)
-	{
-		if (curr->free)
-		{
-			++free_blocks;
-			total_free += curr->size;
-			if (curr->size > largest_free_block)
-				largest_free_block = curr->size;
-		}
-		else
-		{
-			++used_blocks;
-			total_used += curr->size;
-			if (curr->size > curr->requested_size)
-				internal_frag_bytes += (curr->size - curr->requested_size);
-		}
-	}
-
-	double utilization = (HEAP_SIZE != 0)
-		                       ? (100.0 * static_cast<double>(total_used) / static_cast<double>(HEAP_SIZE))
-		                       : 0.0;
-	double internal_frag_ratio = (total_used != 0)
-		                             ? (100.0 * static_cast<double>(internal_frag_bytes) / static_cast<double>(total_used))
-		                             : 0.0;
-	double external_frag_ratio = 0.0;
-	if (total_free != 0 && largest_free_block != 0)
-	{
-		external_frag_ratio = 100.0 * (1.0 - static_cast<double>(largest_free_block) / static_cast<double>(total_free));
-	}
-
-	std::size_t total_requests = g_alloc_requests;
-	double success_rate = 0.0;
-	double failure_rate = 0.0;
-	if (total_requests != 0)
-	{
-		success_rate = 100.0 * static_cast<double>(g_alloc_success) / static_cast<double>(total_requests);
-		failure_rate = 100.0 * static_cast<double>(g_alloc_fail) / static_cast<double>(total_requests);
-	}
-
-	std::cout << "Allocator stats:\n";
-	std::cout << "  Heap size: " << HEAP_SIZE << " bytes\n";
-	std::cout << "  Used:      " << total_used << " bytes in " << used_blocks << " block(s)\n";
-	std::cout << "  Free:      " << total_free << " bytes in " << free_blocks << " block(s)\n";
-	std::cout << "  Internal fragmentation: " << internal_frag_bytes << " bytes (" << internal_frag_ratio << "%)\n";
-	std::cout << "  External fragmentation: " << external_frag_ratio << "%\n";
-	std::cout << "  Largest free block:     " << largest_free_block << " bytes\n";
-	std::cout << "  Allocation requests:    " << total_requests << "\n";
-	std::cout << "    Success:              " << g_alloc_success << " (" << success_rate << "%)\n";
-	std::cout << "    Failures:             " << g_alloc_fail << " (" << failure_rate << "%)\n";
-	std::cout << "  Memory utilization:     " << utilization << "% of heap\n";
-
-	// Dump cache stats as well.
-	std ::cout << "\nCache statistics:\n";
-	cache_dump_stats();
-}
-
+
+// Custom memory allocator implementation.
+// Designed to be used by an external CLI/test harness (e.g., mainn.cpp).
+//
+// All allocator and cache state lives in an AllocatorContext, so several
+// fully independent allocator+cache instances can run side by side (e.g.
+// replaying one trace under every fit strategy on separate threads). The
+// classic allocator_* API operates on a process-wide default context whose
+// cache is the global one cache.cpp's menu configures.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define ALLOCATOR_HAVE_MMAP 1
+#endif
+// Cycle-granular timestamps for the per-operation host timers; elsewhere
+// steady_clock nanoseconds stand in (coarser, but the same histograms work).
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define ALLOCATOR_HAVE_RDTSC 1
+#endif
+#include "allocator.hpp"
+
+// Default startup heap size of the default context; settable via
+// allocator_set_heap_size() before the first allocation.
+std::size_t HEAP_SIZE = 64 * 1024; // default: 64 KB, as before
+std::uint8_t *g_heap = nullptr;    // default context's arena (for offset math in drivers)
+
+// Reserve at least this much virtual address space per context so the heap
+// can grow well past the startup size. Untouched pages cost nothing.
+static constexpr std::size_t ARENA_MIN_RESERVE = 1024ull * 1024 * 1024; // 1 GB
+
+// Header that lives at the beginning of each block inside the arena.
+// [BlockHeader][user bytes ...]
+//
+// Deliberately packed to 32 bytes (it used to be 80): with the 8-32 byte
+// allocations that dominate traces, header overhead decides how densely
+// payloads pack — and the simulated spatial locality with it. Sizes are
+// 32-bit (blocks and heaps are capped at 4 GB), the flags share a word
+// with the start gap, free-list links live inside the free payload itself
+// (see FreeLinks below), and the per-block cache-hit counter moved out of
+// line into the id map.
+struct BlockHeader
+{
+	BlockHeader *next;            // Next block in the list.
+	BlockHeader *prev;            // Previous block in the list (physical predecessor).
+	std::uint32_t size;           // Size of the user area in bytes (actual allocated size).
+	std::uint32_t requested_size; // Size originally requested by the user.
+	int id;                       // Unique identifier for the block.
+	std::uint32_t start_gap : 29; // User area starts this many bytes past the header.
+	std::uint32_t free : 1;       // Whether this block is free or allocated.
+	std::uint32_t hint : 2;       // AccessHint the block's traffic carries.
+
+	// Start address of the user area: right after the header for list-engine
+	// blocks, possibly further in for aligned buddy chunks (the header stays
+	// at the chunk base there). The gap is relative, so headers move freely
+	// (compaction, snapshot restore) without pointer fixups.
+	std::uint8_t *start()
+	{
+		return reinterpret_cast<std::uint8_t *>(this) + sizeof(BlockHeader) + start_gap;
+	}
+	void set_start(std::uint8_t *user)
+	{
+		start_gap = static_cast<std::uint32_t>(
+			user - reinterpret_cast<std::uint8_t *>(this) - sizeof(BlockHeader));
+	}
+
+	// Cache placement hint for this block's simulated traffic: Normal uses
+	// the hierarchy, Streaming is non-temporal (no fills), Uncacheable goes
+	// straight to memory. Free blocks carry Uncacheable.
+	AccessHint access_hint()
+	{
+		return static_cast<AccessHint>(hint);
+	}
+	void set_access_hint(AccessHint value)
+	{
+		hint = static_cast<std::uint32_t>(value);
+	}
+};
+
+// Free-list links of a free (or small-cache-held) block live in the first
+// bytes of its payload — dead space while the block is unallocated — so the
+// header does not carry them. Every block filed in a free list holds at
+// least sizeof(FreeLinks) payload bytes by construction (see
+// split_block_if_needed and buddy_min_span).
+struct FreeLinks
+{
+	BlockHeader *next;
+	BlockHeader *prev;
+};
+
+static FreeLinks &free_links(BlockHeader *block)
+{
+	return *reinterpret_cast<FreeLinks *>(block->start());
+}
+
+// Segregated free lists: class k holds free blocks whose size lies in
+// [2^k, 2^(k+1)). find_fit() only touches the classes that can satisfy a
+// request instead of walking every block in the heap.
+static constexpr std::size_t NUM_SIZE_CLASSES = 32;
+
+// Concurrent mode: the heap is divided into shards, each an independent
+// slice of the arena reservation with its own block list, free lists and
+// lock. Threads hash to a home shard, so with enough shards concurrent
+// allocations rarely contend; frees lock only the owning shard of the
+// block being freed. The default of one shard preserves the classic
+// single-heap layout.
+struct HeapShard
+{
+	BlockHeader *head = nullptr; // Head of the shard's block list.
+	BlockHeader *tail = nullptr; // Last block in the list (highest address).
+	BlockHeader *free_lists[NUM_SIZE_CLASSES] = {};
+	std::uint8_t *base = nullptr; // Shard's slice of the arena reservation.
+	std::size_t size = 0;         // Currently usable bytes of the slice.
+	std::size_t reserved = 0;     // Capacity of the slice.
+	std::mutex lock;
+};
+
+static constexpr std::size_t MAX_SHARDS = 64;
+
+// id -> BlockHeader index so free/read/write/access resolve a handle in O(1)
+// instead of walking the block list. Open addressing with linear probing;
+// entries are erased on free. Ids are never reused (next_id is monotonic),
+// so a lookup of a stale id simply misses instead of aliasing a newer block.
+struct IdMapEntry
+{
+	int id;                   // -1 => empty, -2 => tombstone (erased).
+	std::uint32_t cache_hits; // Times the block was accessed through the cache.
+	BlockHeader *block;       // Header for a live (allocated) block.
+};
+
+static constexpr int ID_MAP_EMPTY = -1;
+static constexpr int ID_MAP_TOMBSTONE = -2;
+
+// Patterns used to detect uninitialized / freed memory accesses.
+static constexpr std::uint8_t PATTERN_UNINITIALIZED = 0xCD;
+static constexpr std::uint8_t PATTERN_FREED         = 0xDD;
+
+// Small-object front end parameters (see SmallCacheSlot below).
+static constexpr std::size_t SMALL_ALIGN = alignof(std::max_align_t);
+static constexpr std::size_t SMALL_MAX_SIZE = 128;
+static constexpr std::size_t NUM_SMALL_CLASSES = SMALL_MAX_SIZE / SMALL_ALIGN;
+static constexpr std::size_t SMALL_REFILL_BATCH = 16;
+static constexpr std::size_t SMALL_CACHE_CAP = 64; // per class; flush half beyond this
+
+FitStrategy parse_strategy(const std::string &s)
+{
+	// Accept common spellings.
+	if (s == "first" || s == "first_fit" || s == "first-fit" || s == "firstfit")
+		return FitStrategy::First;
+	if (s == "best" || s == "best_fit" || s == "best-fit" || s == "bestfit")
+		return FitStrategy::Best;
+	if (s == "worst" || s == "worst_fit" || s == "worst-fit" || s == "worstfit")
+		return FitStrategy::Worst;
+	return FitStrategy::First;
+}
+
+// Allocation engine behind the classic API: the list-based allocator with
+// fit strategies (the historical default), or a binary buddy system for
+// comparing split/merge behavior and power-of-two internal fragmentation
+// against the list engine on identical traces.
+enum class AllocEngine
+{
+	List,
+	Buddy,
+};
+
+// How allocator reads/writes are fed into the cache simulator. Full
+// simulates every access (the historical behavior); Sampled feeds only
+// every Nth access and scales the reported counters back up by N, trading
+// exactness for throughput; Off skips the simulator entirely.
+enum class CacheSimMode
+{
+	Off,
+	Full,
+	Sampled,
+};
+
+// Monotonic generation counter for contexts: thread-local small caches
+// identify their owning context by id, never by (reusable) address.
+static std::atomic<std::uint64_t> g_ctx_id_gen{1};
+
+// Everything one allocator instance needs: arena, shards, id map, stats
+// and a cache hierarchy.
+struct AllocatorContext
+{
+	std::uint64_t ctx_id;
+
+	// Arena.
+	std::uint8_t *heap = nullptr;
+	std::size_t heap_size_config = 64 * 1024; // startup size
+	std::size_t heap_reserved = 0;            // bytes of address space reserved
+	bool heap_mmapped = false;                // arena came from mmap (vs new[])
+	std::size_t shard_stride = 0;             // reservation bytes per shard
+
+	HeapShard shards[MAX_SHARDS];
+	std::size_t num_shards = 1;
+
+	std::atomic<bool> initialized{false};
+	std::mutex init_lock;
+
+	std::atomic<int> next_id{0}; // Monotonically increasing id for allocated blocks.
+
+	IdMapEntry *id_map = nullptr;
+	std::size_t id_map_capacity = 0; // always a power of two
+	std::size_t id_map_used = 0;     // live entries + tombstones
+	std::mutex id_map_lock;
+
+	// Simple allocation statistics.
+	std::atomic<std::size_t> alloc_requests{0};
+	std::atomic<std::size_t> alloc_success{0};
+	std::atomic<std::size_t> alloc_fail{0};
+
+	std::atomic<std::size_t> small_hits{0};    // allocations served by a class cache
+	std::atomic<std::size_t> small_fills{0};   // batch refills from the block list
+	std::atomic<std::size_t> small_flushes{0}; // overflow flushes back to the free lists
+
+	bool debug_fill = true;
+	FitStrategy current_strategy = FitStrategy::First;
+	AllocEngine engine = AllocEngine::List;
+
+	// Cache hierarchy: the default context uses the global cache that the
+	// interactive menu configures; other contexts own a private instance.
+	MultiLevelCache *cache = nullptr;
+	std::mutex *cache_lock = nullptr;
+	MultiLevelCache own_cache;
+	std::mutex own_cache_lock;
+	bool cache_initialized = false;
+
+	// Simulation coupling: mode, sampling period, and a running access
+	// counter for picking every Nth access in Sampled mode.
+	CacheSimMode cache_sim_mode = CacheSimMode::Full;
+	std::size_t cache_sim_interval = 1;
+	std::atomic<std::uint64_t> cache_sim_counter{0};
+
+	AllocatorContext() : ctx_id(g_ctx_id_gen.fetch_add(1, std::memory_order_relaxed)) {}
+};
+
+static AllocatorContext g_default_context;
+
+// Registry of live context ids, so thread-local cache slots can tell a
+// stale context from a live one before flushing into it.
+static std::mutex g_ctx_registry_lock;
+static std::uint64_t g_live_ctx_ids[1 + 16] = {}; // default + up to 16 extra contexts
+static constexpr std::size_t MAX_LIVE_CONTEXTS = sizeof(g_live_ctx_ids) / sizeof(g_live_ctx_ids[0]);
+
+static void ctx_registry_add(std::uint64_t id)
+{
+	std::lock_guard<std::mutex> guard(g_ctx_registry_lock);
+	for (std::size_t i = 0; i < MAX_LIVE_CONTEXTS; ++i)
+	{
+		if (g_live_ctx_ids[i] == 0)
+		{
+			g_live_ctx_ids[i] = id;
+			return;
+		}
+	}
+}
+
+static void ctx_registry_remove(std::uint64_t id)
+{
+	std::lock_guard<std::mutex> guard(g_ctx_registry_lock);
+	for (std::size_t i = 0; i < MAX_LIVE_CONTEXTS; ++i)
+	{
+		if (g_live_ctx_ids[i] == id)
+		{
+			g_live_ctx_ids[i] = 0;
+			return;
+		}
+	}
+}
+
+static bool ctx_registry_contains(std::uint64_t id)
+{
+	std::lock_guard<std::mutex> guard(g_ctx_registry_lock);
+	for (std::size_t i = 0; i < MAX_LIVE_CONTEXTS; ++i)
+		if (g_live_ctx_ids[i] == id)
+			return true;
+	return false;
+}
+
+// Per-(thread, context) small-object cache: carved blocks recycled with a
+// pointer pop/push, bypassing find_fit/split entirely for the 8-128 byte
+// allocations that dominate traces. Cached blocks keep free=false (so
+// neighbor coalescing leaves them alone) and id=-1 (owned by the cache,
+// not reachable through the id map). A class is refilled in batches from
+// the block-list path and flushed back when it overfills.
+struct SmallCacheSlot
+{
+	std::uint64_t ctx_id = 0; // 0 => slot unused
+	AllocatorContext *ctx = nullptr;
+	BlockHeader *lists[NUM_SMALL_CLASSES] = {};
+	std::size_t counts[NUM_SMALL_CLASSES] = {};
+};
+
+static constexpr std::size_t MAX_THREAD_CTX_CACHES = 8;
+static thread_local SmallCacheSlot t_small_slots[MAX_THREAD_CTX_CACHES];
+
+static void small_slot_flush_all(SmallCacheSlot &slot);
+
+static SmallCacheSlot &small_slot_for(AllocatorContext &ctx)
+{
+	for (std::size_t i = 0; i < MAX_THREAD_CTX_CACHES; ++i)
+		if (t_small_slots[i].ctx_id == ctx.ctx_id)
+			return t_small_slots[i];
+
+	for (std::size_t i = 0; i < MAX_THREAD_CTX_CACHES; ++i)
+	{
+		if (t_small_slots[i].ctx_id == 0)
+		{
+			t_small_slots[i].ctx_id = ctx.ctx_id;
+			t_small_slots[i].ctx = &ctx;
+			return t_small_slots[i];
+		}
+	}
+
+	// All slots busy: evict the first one. If its context is gone its
+	// blocks went away with the arena; otherwise flush them back first.
+	SmallCacheSlot &victim = t_small_slots[0];
+	if (ctx_registry_contains(victim.ctx_id))
+		small_slot_flush_all(victim);
+	for (std::size_t c = 0; c < NUM_SMALL_CLASSES; ++c)
+	{
+		victim.lists[c] = nullptr;
+		victim.counts[c] = 0;
+	}
+	victim.ctx_id = ctx.ctx_id;
+	victim.ctx = &ctx;
+	return victim;
+}
+
+static std::size_t id_map_slot(int id, std::size_t capacity)
+{
+	// Cheap integer hash; capacity is a power of two.
+	std::size_t h = static_cast<std::size_t>(id) * 2654435761u;
+	return h & (capacity - 1);
+}
+
+static void id_map_grow(AllocatorContext &ctx);
+
+// Callers hold ctx.id_map_lock.
+static IdMapEntry *id_map_insert(AllocatorContext &ctx, int id, BlockHeader *block)
+{
+	// Keep the load factor (including tombstones) below ~70%.
+	if (ctx.id_map_capacity == 0 || (ctx.id_map_used + 1) * 10 >= ctx.id_map_capacity * 7)
+		id_map_grow(ctx);
+
+	std::size_t slot = id_map_slot(id, ctx.id_map_capacity);
+	while (ctx.id_map[slot].id >= 0)
+		slot = (slot + 1) & (ctx.id_map_capacity - 1);
+
+	if (ctx.id_map[slot].id == ID_MAP_EMPTY)
+		++ctx.id_map_used; // reusing a tombstone does not change the load
+	ctx.id_map[slot].id = id;
+	ctx.id_map[slot].cache_hits = 0;
+	ctx.id_map[slot].block = block;
+	return &ctx.id_map[slot];
+}
+
+static void id_map_grow(AllocatorContext &ctx)
+{
+	std::size_t new_capacity = (ctx.id_map_capacity == 0) ? 256 : ctx.id_map_capacity * 2;
+	IdMapEntry *old_map = ctx.id_map;
+	std::size_t old_capacity = ctx.id_map_capacity;
+
+	ctx.id_map = new IdMapEntry[new_capacity];
+	ctx.id_map_capacity = new_capacity;
+	ctx.id_map_used = 0;
+	for (std::size_t i = 0; i < new_capacity; ++i)
+		ctx.id_map[i].id = ID_MAP_EMPTY;
+
+	// Rehash live entries; tombstones are dropped.
+	for (std::size_t i = 0; i < old_capacity; ++i)
+	{
+		if (old_map[i].id >= 0)
+			id_map_insert(ctx, old_map[i].id, old_map[i].block)->cache_hits =
+				old_map[i].cache_hits;
+	}
+	delete[] old_map;
+}
+
+static IdMapEntry *id_map_lookup(AllocatorContext &ctx, int id)
+{
+	if (ctx.id_map_capacity == 0)
+		return nullptr;
+
+	std::size_t slot = id_map_slot(id, ctx.id_map_capacity);
+	while (ctx.id_map[slot].id != ID_MAP_EMPTY)
+	{
+		if (ctx.id_map[slot].id == id)
+			return &ctx.id_map[slot];
+		slot = (slot + 1) & (ctx.id_map_capacity - 1);
+	}
+	return nullptr;
+}
+
+static std::size_t size_class_index(std::size_t size)
+{
+	// floor(log2(size)), clamped to the last class.
+	std::size_t idx = 0;
+	while (idx + 1 < NUM_SIZE_CLASSES && (static_cast<std::size_t>(1) << (idx + 1)) <= size)
+		++idx;
+	return idx;
+}
+
+// Free-list maintenance. The links live in the payload (see FreeLinks) and
+// are only meaningful while the block is filed. Callers hold the shard lock.
+// Class lists are kept address-ordered so the strategies resolve choices the
+// same way the old bottom-up scan of the whole block list did (First takes
+// the lowest-address fit, ties go to the lowest address): identical runs
+// produce identical layouts before and after the segregation.
+static void free_list_insert(HeapShard &shard, BlockHeader *block)
+{
+	std::size_t idx = size_class_index(block->size);
+	BlockHeader *prev = nullptr;
+	BlockHeader *curr = shard.free_lists[idx];
+	while (curr && curr < block)
+	{
+		prev = curr;
+		curr = free_links(curr).next;
+	}
+	FreeLinks &links = free_links(block);
+	links.prev = prev;
+	links.next = curr;
+	if (prev)
+		free_links(prev).next = block;
+	else
+		shard.free_lists[idx] = block;
+	if (curr)
+		free_links(curr).prev = block;
+}
+
+static void free_list_remove(HeapShard &shard, BlockHeader *block)
+{
+	std::size_t idx = size_class_index(block->size);
+	FreeLinks &links = free_links(block);
+	if (links.prev)
+		free_links(links.prev).next = links.next;
+	else
+		shard.free_lists[idx] = links.next;
+	if (links.next)
+		free_links(links.next).prev = links.prev;
+}
+
+// Map a heap address back to the shard whose slice contains it.
+static HeapShard &shard_for_block(AllocatorContext &ctx, BlockHeader *block)
+{
+	std::size_t offset = static_cast<std::size_t>(reinterpret_cast<std::uint8_t *>(block) - ctx.heap);
+	std::size_t idx = (ctx.shard_stride != 0) ? offset / ctx.shard_stride : 0;
+	if (idx >= ctx.num_shards)
+		idx = ctx.num_shards - 1;
+	return ctx.shards[idx];
+}
+
+// Home shard for the calling thread: threads are hashed across shards so
+// concurrent allocation spreads out instead of contending on one lock.
+static std::size_t home_shard_index(AllocatorContext &ctx)
+{
+	static thread_local std::size_t t_thread_hash =
+		std::hash<std::thread::id>{}(std::this_thread::get_id());
+	return t_thread_hash % ctx.num_shards;
+}
+
+// Map (or allocate) the arena backing store and lay out the shard slices.
+// Called lazily from ctx_init() so heap size / shard count can be set first.
+static void arena_init(AllocatorContext &ctx)
+{
+	if (ctx.heap)
+		return;
+
+	std::size_t heap_size = ctx.heap_size_config;
+	std::size_t reserve = (heap_size > ARENA_MIN_RESERVE) ? heap_size : ARENA_MIN_RESERVE;
+
+#ifdef ALLOCATOR_HAVE_MMAP
+	void *mem = mmap(nullptr, reserve, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mem != MAP_FAILED)
+	{
+		ctx.heap = static_cast<std::uint8_t *>(mem);
+		ctx.heap_reserved = reserve;
+		ctx.heap_mmapped = true;
+	}
+#endif
+	if (!ctx.heap)
+	{
+		// Fallback: plain allocation sized to the heap only (no growth headroom).
+		ctx.heap = new std::uint8_t[heap_size];
+		ctx.heap_reserved = heap_size;
+		ctx.heap_mmapped = false;
+	}
+
+	// Carve the reservation into equal shard slices.
+	ctx.shard_stride = (ctx.heap_reserved / ctx.num_shards) & ~(SMALL_ALIGN - 1);
+	std::size_t initial = heap_size / ctx.num_shards;
+	if (initial < sizeof(BlockHeader) + 64)
+		initial = sizeof(BlockHeader) + 64;
+	if (initial > ctx.shard_stride)
+		initial = ctx.shard_stride;
+
+	for (std::size_t i = 0; i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		shard.base = ctx.heap + i * ctx.shard_stride;
+		shard.reserved = ctx.shard_stride;
+		shard.size = initial;
+	}
+}
+
+static void arena_release(AllocatorContext &ctx)
+{
+	if (!ctx.heap)
+		return;
+#ifdef ALLOCATOR_HAVE_MMAP
+	if (ctx.heap_mmapped)
+		munmap(ctx.heap, ctx.heap_reserved);
+	else
+		delete[] ctx.heap;
+#else
+	delete[] ctx.heap;
+#endif
+	ctx.heap = nullptr;
+	ctx.heap_reserved = 0;
+	ctx.heap_mmapped = false;
+	ctx.shard_stride = 0;
+}
+
+static void ctx_init(AllocatorContext &ctx)
+{
+	if (ctx.initialized.load(std::memory_order_acquire))
+		return; // already initialized
+
+	std::lock_guard<std::mutex> guard(ctx.init_lock);
+	if (ctx.initialized.load(std::memory_order_relaxed))
+		return; // raced with another initializer
+
+	if (&ctx == &g_default_context)
+	{
+		ctx.heap_size_config = HEAP_SIZE;
+		ctx.cache = &g_cache;
+		ctx.cache_lock = &g_cache_lock;
+	}
+	else if (!ctx.cache)
+	{
+		ctx.cache = &ctx.own_cache;
+		ctx.cache_lock = &ctx.own_cache_lock;
+	}
+
+	arena_init(ctx);
+
+	if (&ctx == &g_default_context)
+		g_heap = ctx.heap;
+
+	if (!ctx.cache_initialized)
+	{
+		if (&ctx == &g_default_context)
+			cache_init_default();
+		else
+			cache_setup_default_levels(*ctx.cache);
+		// Re-apply the sampling scale: cache setup resets it to 1.
+		if (ctx.cache_sim_mode == CacheSimMode::Sampled)
+			ctx.cache->set_sample_scale(ctx.cache_sim_interval);
+		ctx.cache_initialized = true;
+	}
+
+	// Create a single big free block spanning each shard's slice.
+	for (std::size_t i = 0; i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		if (ctx.engine == AllocEngine::Buddy)
+		{
+			// The buddy merge math XORs chunk-sized offsets, so the shard's
+			// region is trimmed to the largest power of two that fits and
+			// stays fixed for the run (no arena growth under this engine).
+			std::size_t region = 1;
+			while (region * 2 <= shard.size)
+				region *= 2;
+			shard.size = region;
+		}
+		BlockHeader *head = reinterpret_cast<BlockHeader *>(shard.base);
+		head->id = -1;
+		head->start_gap = 0;
+		head->size = shard.size - sizeof(BlockHeader);
+		head->requested_size = 0;
+		head->free = true;
+		head->set_access_hint(AccessHint::Uncacheable);
+		head->next = nullptr;
+		head->prev = nullptr;
+		shard.head = head;
+		shard.tail = head;
+		for (std::size_t c = 0; c < NUM_SIZE_CLASSES; ++c)
+			shard.free_lists[c] = nullptr;
+		free_list_insert(shard, head);
+	}
+
+	ctx_registry_add(ctx.ctx_id);
+	ctx.initialized.store(true, std::memory_order_release);
+}
+
+static std::size_t align_size(std::size_t size)
+{
+	const std::size_t align = alignof(std::max_align_t);
+	return (size + align - 1) & ~(align - 1);
+}
+
+// --------------------------- Operation timing ---------------------------- //
+
+// Host-time cost per operation class, kept apart from the simulated cycle
+// counters: m_total_penalty is what the modeled hardware would pay, these
+// histograms are what the simulator itself costs per call. Timestamps come
+// from rdtsc where available (unserialized — a fence would cost more than
+// the durations being measured) and steady_clock nanoseconds elsewhere, so
+// the unit differs per platform but is consistent within a run. Samples
+// land in power-of-two-wide buckets via relaxed atomics, which keeps
+// recording cheap enough to leave on during benchmark runs; the derived
+// p99 is exact to within one bucket.
+
+enum class TimedOp
+{
+	Malloc = 0,
+	Free,
+	Read,
+	Write,
+	CacheAccess,
+};
+
+static constexpr std::size_t TIMED_OP_COUNT = 5;
+static constexpr std::size_t TIMED_OP_BUCKETS = 64; // bucket b covers [2^b, 2^(b+1))
+
+static const char *timed_op_name(TimedOp op)
+{
+	switch (op)
+	{
+	case TimedOp::Malloc: return "malloc";
+	case TimedOp::Free: return "free";
+	case TimedOp::Read: return "read";
+	case TimedOp::Write: return "write";
+	case TimedOp::CacheAccess: return "cache_access";
+	}
+	return "?";
+}
+
+// The sample count is not stored separately: it is the sum of the bucket
+// counters, computed at print time, which keeps the record path to two
+// atomic adds plus a (rarely-taken) max update.
+struct OpTimeHistogram
+{
+	std::atomic<std::uint64_t> sum{0};
+	std::atomic<std::uint64_t> max{0};
+	std::atomic<std::uint64_t> buckets[TIMED_OP_BUCKETS]{};
+};
+
+static OpTimeHistogram g_op_times[TIMED_OP_COUNT];
+
+static inline std::uint64_t op_time_now()
+{
+#ifdef ALLOCATOR_HAVE_RDTSC
+	return __rdtsc();
+#else
+	return static_cast<std::uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+static const char *op_time_unit()
+{
+#ifdef ALLOCATOR_HAVE_RDTSC
+	return "rdtsc ticks";
+#else
+	return "ns";
+#endif
+}
+
+static inline void op_time_record(TimedOp op, std::uint64_t start)
+{
+	std::uint64_t elapsed = op_time_now() - start;
+	OpTimeHistogram &h = g_op_times[static_cast<std::size_t>(op)];
+	h.sum.fetch_add(elapsed, std::memory_order_relaxed);
+	std::uint64_t seen = h.max.load(std::memory_order_relaxed);
+	while (elapsed > seen &&
+	       !h.max.compare_exchange_weak(seen, elapsed, std::memory_order_relaxed))
+	{
+	}
+	std::size_t bucket = elapsed
+		? 63 - static_cast<std::size_t>(__builtin_clzll(elapsed))
+		: 0;
+	h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Decide whether this operation's accesses reach the simulator: always
+// under Full, never under Off, every cache_sim_interval-th under Sampled.
+static bool ctx_cache_sim_take(AllocatorContext &ctx)
+{
+	switch (ctx.cache_sim_mode)
+	{
+	case CacheSimMode::Off:
+		return false;
+	case CacheSimMode::Full:
+		return true;
+	case CacheSimMode::Sampled:
+		return ctx.cache_sim_counter.fetch_add(1, std::memory_order_relaxed)
+		       % ctx.cache_sim_interval == 0;
+	}
+	return true;
+}
+
+// Core id this thread presents to the cache topology: the same per-thread
+// hash that spreads threads over shards spreads them over cores (the
+// hierarchy reduces it modulo its core count, and ignores it entirely on
+// a single-core setup).
+static std::size_t thread_cache_core()
+{
+	static thread_local std::size_t t_core =
+		std::hash<std::thread::id>{}(std::this_thread::get_id());
+	return t_core;
+}
+
+// Simulate a byte-range access through the context's cache hierarchy,
+// carrying the accessed block's placement hint. Timed after the sampling
+// gate so Off/Sampled modes do not flood the histogram with empty calls.
+static void ctx_cache_access_range(AllocatorContext &ctx, std::uintptr_t addr,
+                                   std::size_t len, bool is_write,
+                                   AccessHint hint = AccessHint::Normal)
+{
+	if (!ctx_cache_sim_take(ctx))
+		return;
+	std::uint64_t t0 = op_time_now();
+	{
+		std::lock_guard<std::mutex> guard(*ctx.cache_lock);
+		ctx.cache->access_range(addr, len, is_write, thread_cache_core(), hint);
+	}
+	op_time_record(TimedOp::CacheAccess, t0);
+}
+
+static void ctx_cache_access(AllocatorContext &ctx, std::uintptr_t addr, bool is_write,
+                             AccessHint hint = AccessHint::Normal)
+{
+	if (!ctx_cache_sim_take(ctx))
+		return;
+	std::uint64_t t0 = op_time_now();
+	{
+		std::lock_guard<std::mutex> guard(*ctx.cache_lock);
+		ctx.cache->access(addr, is_write, thread_cache_core(), hint);
+	}
+	op_time_record(TimedOp::CacheAccess, t0);
+}
+
+// Locate a free block via the shard's segregated free lists.
+// The strategy semantics match the old bottom-up scan of the whole block
+// list: First returns the lowest-address fitting block, Best the tightest
+// fit and Worst the largest block (address-ordered class lists break ties
+// toward the lowest address in every case). Best scans only the class that
+// straddles the request, Worst only the highest populated class, and First
+// the straddling class plus one head probe per class above it, so lookup
+// cost stays bounded by a single class list instead of the whole heap.
+// Callers hold the shard lock.
+static BlockHeader *find_fit(HeapShard &shard, std::size_t size, FitStrategy strategy)
+{
+	if (strategy == FitStrategy::Worst)
+	{
+		// The largest free block always lives in the highest populated class.
+		for (std::size_t c = NUM_SIZE_CLASSES; c-- > 0;)
+		{
+			BlockHeader *largest = nullptr;
+			for (BlockHeader *curr = shard.free_lists[c]; curr; curr = free_links(curr).next)
+			{
+				if (!largest || curr->size > largest->size)
+					largest = curr;
+			}
+			if (largest)
+				return (largest->size >= size) ? largest : nullptr;
+		}
+		return nullptr;
+	}
+
+	std::size_t start = size_class_index(size);
+
+	if (strategy == FitStrategy::First)
+	{
+		// A lower-address fit can live in any class at or above the
+		// request's: within the straddling class the first fitting block in
+		// scan order is its lowest-address fit, and in every class above
+		// (where all blocks fit) it is simply the head.
+		BlockHeader *lowest = nullptr;
+		for (std::size_t c = start; c < NUM_SIZE_CLASSES; ++c)
+		{
+			BlockHeader *curr = shard.free_lists[c];
+			if (c == start)
+				while (curr && curr->size < size)
+					curr = free_links(curr).next;
+			if (curr && (!lowest || curr < lowest))
+				lowest = curr;
+		}
+		return lowest;
+	}
+
+	for (std::size_t c = start; c < NUM_SIZE_CLASSES; ++c)
+	{
+		// Blocks in classes above the request's own class always fit; only
+		// the request's class needs a per-block size check.
+		BlockHeader *candidate = nullptr;
+		for (BlockHeader *curr = shard.free_lists[c]; curr; curr = free_links(curr).next)
+		{
+			if (curr->size < size)
+				continue;
+
+			if (!candidate || curr->size < candidate->size)
+				candidate = curr;
+		}
+		if (candidate)
+			return candidate;
+	}
+
+	return nullptr;
+}
+
+static BlockHeader *find_block_by_id(AllocatorContext &ctx, int id)
+{
+	std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+	IdMapEntry *entry = id_map_lookup(ctx, id);
+	return entry ? entry->block : nullptr;
+}
+
+// Callers hold the shard lock.
+static void split_block_if_needed(HeapShard &shard, BlockHeader *block, std::size_t size)
+{
+	// Assumes block is free and block->size >= size.
+	std::size_t remaining = block->size - size;
+	// Only split if there's enough space to hold a new header plus a payload
+	// that can carry the free-list links.
+	if (remaining < sizeof(BlockHeader) + sizeof(FreeLinks))
+		return;
+
+	std::uint8_t *base = reinterpret_cast<std::uint8_t *>(block);
+	BlockHeader *new_block = reinterpret_cast<BlockHeader *>(base + sizeof(BlockHeader) + size);
+
+	new_block->id = -1;
+	new_block->start_gap = 0;
+	new_block->size = remaining - sizeof(BlockHeader);
+	new_block->requested_size = 0;
+	new_block->free = true;
+	new_block->set_access_hint(AccessHint::Uncacheable);
+	new_block->next = block->next;
+	new_block->prev = block;
+	if (new_block->next)
+		new_block->next->prev = new_block;
+
+	block->size = size;
+	block->next = new_block;
+	if (shard.tail == block)
+		shard.tail = new_block;
+	free_list_insert(shard, new_block);
+}
+
+static std::uint8_t *block_end(BlockHeader *block)
+{
+	return block->start() + block->size;
+}
+
+// Grow the usable heap of a shard into its reserved slice after a failed
+// fit. Returns true if the shard was extended enough to hold `needed` more
+// bytes. Callers hold the shard lock.
+static bool arena_grow(HeapShard &shard, std::size_t needed)
+{
+	if (shard.size >= shard.reserved)
+		return false; // reservation exhausted
+
+	// Grow geometrically, but at least enough for the failed request.
+	std::size_t grow = shard.size;
+	if (grow < needed + sizeof(BlockHeader))
+		grow = needed + sizeof(BlockHeader);
+	if (grow > shard.reserved - shard.size)
+		grow = shard.reserved - shard.size;
+	if (grow < needed + sizeof(BlockHeader))
+		return false;
+
+	std::uint8_t *old_end = shard.base + shard.size;
+	shard.size += grow;
+
+	if (shard.tail && shard.tail->free && block_end(shard.tail) == old_end)
+	{
+		// Extend the trailing free block in place.
+		free_list_remove(shard, shard.tail);
+		shard.tail->size += grow;
+		free_list_insert(shard, shard.tail);
+	}
+	else
+	{
+		// Append a fresh free block covering the new region.
+		BlockHeader *block = reinterpret_cast<BlockHeader *>(old_end);
+		block->id = -1;
+		block->start_gap = 0;
+		block->size = grow - sizeof(BlockHeader);
+		block->requested_size = 0;
+		block->free = true;
+		block->set_access_hint(AccessHint::Uncacheable);
+		block->next = nullptr;
+		block->prev = shard.tail;
+		if (shard.tail)
+			shard.tail->next = block;
+		shard.tail = block;
+		free_list_insert(shard, block);
+	}
+
+	return true;
+}
+
+// Merge a free block with an adjacent free physical successor.
+// The merged block absorbs next's header and payload; free-list filing is
+// refreshed since the merge changes the size class. Callers hold the shard
+// lock.
+static void merge_with_next(HeapShard &shard, BlockHeader *block)
+{
+	BlockHeader *next = block->next;
+	free_list_remove(shard, block);
+	free_list_remove(shard, next);
+	block->size += sizeof(BlockHeader) + next->size;
+	block->requested_size = 0;
+	block->next = next->next;
+	if (block->next)
+		block->next->prev = block;
+	if (shard.tail == next)
+		shard.tail = block;
+	free_list_insert(shard, block);
+}
+
+// Merge a newly freed block with its physical neighbors in O(1) using the
+// prev/next links instead of rescanning the whole heap. Callers hold the
+// shard lock.
+static void coalesce_with_neighbors(HeapShard &shard, BlockHeader *block)
+{
+	BlockHeader *next = block->next;
+	if (next && next->free && block_end(block) == reinterpret_cast<std::uint8_t *>(next))
+		merge_with_next(shard, block);
+
+	BlockHeader *prev = block->prev;
+	if (prev && prev->free && block_end(prev) == reinterpret_cast<std::uint8_t *>(block))
+		merge_with_next(shard, prev);
+}
+
+// Carve a block from a shard's free lists, growing the shard or falling
+// back to the other shards if the home shard cannot satisfy the request.
+static BlockHeader *carve_block(AllocatorContext &ctx, std::size_t aligned_size, FitStrategy strategy)
+{
+	std::size_t home = home_shard_index(ctx);
+	for (std::size_t attempt = 0; attempt < ctx.num_shards; ++attempt)
+	{
+		HeapShard &shard = ctx.shards[(home + attempt) % ctx.num_shards];
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		BlockHeader *block = find_fit(shard, aligned_size, strategy);
+		if (!block && arena_grow(shard, aligned_size))
+			block = find_fit(shard, aligned_size, strategy);
+		if (block)
+		{
+			free_list_remove(shard, block);
+			split_block_if_needed(shard, block, aligned_size);
+			// Mark the block in-use before the shard lock drops, or a
+			// concurrent free of a neighbor could try to merge with it.
+			block->free = false;
+			block->id = -1;
+			return block;
+		}
+	}
+	return nullptr;
+}
+
+static std::size_t small_class_index(std::size_t aligned_size)
+{
+	// aligned_size is a non-zero multiple of SMALL_ALIGN.
+	return aligned_size / SMALL_ALIGN - 1;
+}
+
+// Carve up to SMALL_REFILL_BATCH blocks of the class size from the block
+// list and push them onto the calling thread's class cache.
+static void small_cache_refill(AllocatorContext &ctx, SmallCacheSlot &slot,
+                               std::size_t aligned_size, FitStrategy strategy)
+{
+	std::size_t idx = small_class_index(aligned_size);
+	ctx.small_fills.fetch_add(1, std::memory_order_relaxed);
+
+	for (std::size_t n = 0; n < SMALL_REFILL_BATCH; ++n)
+	{
+		BlockHeader *block = carve_block(ctx, aligned_size, strategy);
+		if (!block)
+			return; // heap exhausted; caller falls back to the slow path
+
+		block->set_access_hint(AccessHint::Uncacheable);
+		free_links(block).next = slot.lists[idx];
+		slot.lists[idx] = block;
+		++slot.counts[idx];
+	}
+}
+
+static BlockHeader *small_cache_pop(AllocatorContext &ctx, std::size_t aligned_size,
+                                    FitStrategy strategy)
+{
+	SmallCacheSlot &slot = small_slot_for(ctx);
+	std::size_t idx = small_class_index(aligned_size);
+	if (!slot.lists[idx])
+	{
+		small_cache_refill(ctx, slot, aligned_size, strategy);
+		if (!slot.lists[idx])
+			return nullptr;
+	}
+	else
+	{
+		ctx.small_hits.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	BlockHeader *block = slot.lists[idx];
+	slot.lists[idx] = free_links(block).next;
+	--slot.counts[idx];
+	return block;
+}
+
+// Return a freed small block to the calling thread's class cache; flush
+// half the cache back to the real free lists when a class overfills.
+static void small_cache_push(AllocatorContext &ctx, BlockHeader *block)
+{
+	SmallCacheSlot &slot = small_slot_for(ctx);
+	std::size_t idx = small_class_index(block->size);
+	free_links(block).next = slot.lists[idx];
+	slot.lists[idx] = block;
+	++slot.counts[idx];
+
+	if (slot.counts[idx] <= SMALL_CACHE_CAP)
+		return;
+
+	ctx.small_flushes.fetch_add(1, std::memory_order_relaxed);
+	while (slot.counts[idx] > SMALL_CACHE_CAP / 2)
+	{
+		BlockHeader *flushed = slot.lists[idx];
+		slot.lists[idx] = free_links(flushed).next;
+		--slot.counts[idx];
+
+		HeapShard &shard = shard_for_block(ctx, flushed);
+		std::lock_guard<std::mutex> guard(shard.lock);
+		flushed->free = true;
+		free_list_insert(shard, flushed);
+		coalesce_with_neighbors(shard, flushed);
+	}
+}
+
+// Flush every class of a slot back to its context's free lists.
+static void small_slot_flush_all(SmallCacheSlot &slot)
+{
+	AllocatorContext &ctx = *slot.ctx;
+	for (std::size_t idx = 0; idx < NUM_SMALL_CLASSES; ++idx)
+	{
+		while (slot.lists[idx])
+		{
+			BlockHeader *flushed = slot.lists[idx];
+			slot.lists[idx] = free_links(flushed).next;
+			--slot.counts[idx];
+
+			HeapShard &shard = shard_for_block(ctx, flushed);
+			std::lock_guard<std::mutex> guard(shard.lock);
+			flushed->free = true;
+			free_list_insert(shard, flushed);
+			coalesce_with_neighbors(shard, flushed);
+		}
+	}
+}
+
+// ------------------------------ Buddy engine ----------------------------- //
+//
+// Second engine behind the same API: chunks are powers of two, a split
+// produces two buddies whose shard offsets differ in exactly one bit, and
+// a free merges with its sibling (offset XOR span) whenever that sibling
+// is itself a whole free chunk of the same size — O(log n) bounded work
+// instead of list scans, bought with power-of-two internal fragmentation.
+// Headers stay embedded at the chunk base and the physical/free lists are
+// maintained as usual, so ids, reads/writes, stats collection and the
+// cache simulation work unchanged (payload sizes of distinct orders never
+// land in the same segregated class, so each class head is a chunk of
+// exactly one order). The small-object cache and compaction are list-
+// engine features and are bypassed here.
+
+static std::uintptr_t align_up(std::uintptr_t value, std::size_t align); // defined with aligned alloc
+
+// Whole-chunk span of a block, header to chunk end — always a power of
+// two. The user area may start past the header (aligned allocations), so
+// the span is reconstructed from start + size rather than size alone.
+static std::size_t buddy_chunk_span(BlockHeader *hdr)
+{
+	return static_cast<std::size_t>(hdr->start() + hdr->size - reinterpret_cast<std::uint8_t *>(hdr));
+}
+
+// Smallest chunk the engine hands out: room for a header plus one
+// SMALL_ALIGN'd payload granule.
+static std::size_t buddy_min_span()
+{
+	std::size_t span = 1;
+	while (span < sizeof(BlockHeader) + SMALL_ALIGN)
+		span <<= 1;
+	return span;
+}
+
+// Normalize a block to a whole free chunk and file it. Callers hold the
+// shard lock.
+static void buddy_make_free(HeapShard &shard, BlockHeader *hdr, std::size_t span)
+{
+	hdr->id = -1;
+	hdr->start_gap = 0;
+	hdr->size = span - sizeof(BlockHeader);
+	hdr->requested_size = 0;
+	hdr->free = true;
+	hdr->set_access_hint(AccessHint::Uncacheable);
+	free_list_insert(shard, hdr);
+}
+
+// Carve a chunk of at least need_span bytes (header included): take the
+// smallest free chunk that fits and split it down, each split's upper
+// half becoming a free buddy of its own. Returns the block marked in-use,
+// or nullptr when every shard is exhausted.
+static BlockHeader *buddy_carve(AllocatorContext &ctx, std::size_t need_span)
+{
+	std::size_t target = buddy_min_span();
+	while (target < need_span)
+		target <<= 1;
+
+	std::size_t home = home_shard_index(ctx);
+	for (std::size_t attempt = 0; attempt < ctx.num_shards; ++attempt)
+	{
+		HeapShard &shard = ctx.shards[(home + attempt) % ctx.num_shards];
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		BlockHeader *block = nullptr;
+		for (std::size_t span = target; span <= shard.size; span <<= 1)
+		{
+			BlockHeader *candidate = shard.free_lists[size_class_index(span - sizeof(BlockHeader))];
+			if (candidate)
+			{
+				block = candidate;
+				break;
+			}
+		}
+		if (!block)
+			continue;
+
+		free_list_remove(shard, block);
+		std::size_t span = buddy_chunk_span(block);
+
+		while (span > target)
+		{
+			span >>= 1;
+			BlockHeader *upper = reinterpret_cast<BlockHeader *>(
+				reinterpret_cast<std::uint8_t *>(block) + span);
+			upper->next = block->next;
+			upper->prev = block;
+			if (upper->next)
+				upper->next->prev = upper;
+			if (shard.tail == block)
+				shard.tail = upper;
+			block->next = upper;
+			buddy_make_free(shard, upper, span);
+		}
+
+		// Mark in-use before the shard lock drops (same reasoning as
+		// carve_block: a concurrent free must not merge with this chunk).
+		block->start_gap = 0;
+		block->size = span - sizeof(BlockHeader);
+		block->free = false;
+		block->id = -1;
+		return block;
+	}
+	return nullptr;
+}
+
+// Buddy-engine allocation shared by ctx_malloc and ctx_malloc_aligned;
+// align <= SMALL_ALIGN means the natural header-adjacent placement.
+static int buddy_alloc(AllocatorContext &ctx, std::size_t size, std::size_t align)
+{
+	ctx.alloc_requests.fetch_add(1, std::memory_order_relaxed);
+
+	std::size_t need = align_size(size) + sizeof(BlockHeader);
+	if (align > SMALL_ALIGN)
+		need += align; // headroom for the worst-case skew
+
+	BlockHeader *block = buddy_carve(ctx, need);
+	if (!block)
+	{
+		ctx.alloc_fail.fetch_add(1, std::memory_order_relaxed);
+		return -1;
+	}
+
+	if (align > SMALL_ALIGN)
+	{
+		// The header must stay at the chunk base (the merge math depends
+		// on it); only the user area moves up to the aligned address.
+		std::uint8_t *end = block->start() + block->size;
+		std::uint8_t *user = reinterpret_cast<std::uint8_t *>(
+			align_up(reinterpret_cast<std::uintptr_t>(block->start()), align));
+		block->set_start(user);
+		block->size = static_cast<std::size_t>(end - user);
+	}
+
+	block->id = ctx.next_id.fetch_add(1, std::memory_order_relaxed);
+	block->set_access_hint(AccessHint::Normal);
+	block->requested_size = size;
+	{
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		id_map_insert(ctx, block->id, block);
+	}
+	if (ctx.debug_fill)
+		std::memset(block->start(), PATTERN_UNINITIALIZED, block->size);
+	ctx.alloc_success.fetch_add(1, std::memory_order_relaxed);
+	return block->id;
+}
+
+// Free a buddy block: merge with the sibling chunk while that sibling is
+// a whole free chunk of the same span, then file the result.
+static void buddy_free_block(AllocatorContext &ctx, BlockHeader *hdr)
+{
+	HeapShard &shard = shard_for_block(ctx, hdr);
+	std::lock_guard<std::mutex> guard(shard.lock);
+
+	std::size_t span = buddy_chunk_span(hdr);
+	while (span < shard.size)
+	{
+		std::size_t offset = static_cast<std::size_t>(
+			reinterpret_cast<std::uint8_t *>(hdr) - shard.base);
+		std::size_t buddy_off = offset ^ span;
+		BlockHeader *buddy = reinterpret_cast<BlockHeader *>(shard.base + buddy_off);
+		if (!buddy->free || buddy_chunk_span(buddy) != span)
+			break; // sibling is in use or partially split; stop merging
+
+		// The sibling is adjacent in the physical list by construction;
+		// the lower chunk absorbs the upper one.
+		free_list_remove(shard, buddy);
+		BlockHeader *left = (buddy_off < offset) ? buddy : hdr;
+		BlockHeader *right = (left == hdr) ? buddy : hdr;
+		left->next = right->next;
+		if (left->next)
+			left->next->prev = left;
+		if (shard.tail == right)
+			shard.tail = left;
+		hdr = left;
+		span <<= 1;
+	}
+
+	buddy_make_free(shard, hdr, span);
+}
+
+// ----------------------- Context-based operations ----------------------- //
+
+static int ctx_malloc(AllocatorContext &ctx, std::size_t size, FitStrategy strategy)
+{
+	ctx_init(ctx);
+	if (size == 0)
+		return -1;
+	if (ctx.engine == AllocEngine::Buddy)
+		return buddy_alloc(ctx, size, 0); // fit strategies are list-engine only
+
+	// Track allocation attempts for statistics.
+	ctx.alloc_requests.fetch_add(1, std::memory_order_relaxed);
+	std::size_t requested_size = size;
+	std::size_t aligned_size = align_size(size);
+
+	BlockHeader *block = nullptr;
+	if (aligned_size <= SMALL_MAX_SIZE)
+		block = small_cache_pop(ctx, aligned_size, strategy);
+
+	if (!block)
+	{
+		block = carve_block(ctx, aligned_size, strategy);
+		if (!block)
+		{
+			ctx.alloc_fail.fetch_add(1, std::memory_order_relaxed);
+			return -1; // out of memory
+		}
+	}
+
+	block->free = false;
+	block->id = ctx.next_id.fetch_add(1, std::memory_order_relaxed);
+	block->set_access_hint(AccessHint::Normal);
+	block->start_gap = 0;
+	block->requested_size = requested_size;
+	{
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		id_map_insert(ctx, block->id, block);
+	}
+	// Mark the entire allocated region as uninitialized.
+	if (ctx.debug_fill)
+		std::memset(block->start(), PATTERN_UNINITIALIZED, block->size);
+	ctx.alloc_success.fetch_add(1, std::memory_order_relaxed);
+
+	return block->id;
+}
+
+static void ctx_free(AllocatorContext &ctx, int id)
+{
+	ctx_init(ctx);
+	if (id < 0)
+		return; // invalid id
+
+	BlockHeader *hdr = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		IdMapEntry *entry = id_map_lookup(ctx, id);
+		if (!entry)
+			return; // not found or already free
+		hdr = entry->block;
+		entry->id = ID_MAP_TOMBSTONE;
+		entry->block = nullptr;
+	}
+
+	hdr->id = -1;
+	hdr->set_access_hint(AccessHint::Uncacheable);
+	// Mark freed memory with a distinct pattern.
+	if (ctx.debug_fill)
+		std::memset(hdr->start(), PATTERN_FREED, hdr->size);
+
+	if (ctx.engine == AllocEngine::Buddy)
+	{
+		buddy_free_block(ctx, hdr);
+		return;
+	}
+
+	// Small blocks of an exact class size are recycled through the
+	// small-object cache instead of the free lists.
+	if (hdr->size <= SMALL_MAX_SIZE && hdr->size % SMALL_ALIGN == 0)
+	{
+		small_cache_push(ctx, hdr);
+		return;
+	}
+
+	HeapShard &shard = shard_for_block(ctx, hdr);
+	std::lock_guard<std::mutex> guard(shard.lock);
+	hdr->free = true;
+	free_list_insert(shard, hdr);
+	coalesce_with_neighbors(shard, hdr);
+}
+
+// Concurrently freeing a block that another thread is reading or writing
+// is a usage error, exactly as with a real allocator.
+static bool ctx_read(AllocatorContext &ctx, int id, std::size_t offset, void *dst, std::size_t size)
+{
+	ctx_init(ctx);
+	if (id < 0 || !dst || size == 0)
+		return false;
+
+	BlockHeader *hdr = find_block_by_id(ctx, id);
+	if (!hdr || hdr->free)
+		return false;
+
+	if (offset + size > hdr->requested_size)
+		return false; // out of user-requested bounds
+
+	auto *src_bytes = hdr->start() + offset;
+	auto *dst_bytes = static_cast<std::uint8_t *>(dst);
+	bool has_garbage = false;
+
+	// Simulate the whole read at cache-block granularity in one call.
+	ctx_cache_access_range(ctx, reinterpret_cast<std::uintptr_t>(src_bytes), size, false,
+	                       hdr->access_hint());
+
+	if (ctx.debug_fill)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			std::uint8_t value = src_bytes[i];
+			if (value == PATTERN_UNINITIALIZED || value == PATTERN_FREED)
+				has_garbage = true;
+			dst_bytes[i] = value;
+		}
+	}
+	else
+	{
+		// Fills are off: garbage cannot be told apart from data, so just copy.
+		std::memcpy(dst_bytes, src_bytes, size);
+	}
+
+	if (has_garbage)
+		return false;
+	return true;
+}
+
+static bool ctx_write(AllocatorContext &ctx, int id, std::size_t offset, const void *src, std::size_t size)
+{
+	ctx_init(ctx);
+	if (id < 0 || !src || size == 0)
+		return false;
+
+	BlockHeader *hdr = find_block_by_id(ctx, id);
+	if (!hdr || hdr->free)
+		return false;
+
+	if (offset + size > hdr->requested_size)
+		return false; // out of user-requested bounds
+
+	auto *dst_bytes = hdr->start() + offset;
+	auto *src_bytes = static_cast<const std::uint8_t *>(src);
+	bool has_garbage = false;
+
+	// First pass: check for uninitialized/freed bytes without modifying memory.
+	// Skipped when debug fills are off (there is no pattern to look for).
+	if (ctx.debug_fill)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			std::uint8_t old_value = dst_bytes[i];
+			if (old_value == PATTERN_UNINITIALIZED || old_value == PATTERN_FREED)
+			{
+				has_garbage = true;
+				break;
+			}
+		}
+	}
+
+	// if (has_garbage)
+	// 	return false;
+
+	// Second pass: perform the actual write; the cache sees the whole range
+	// at cache-block granularity in one call.
+	ctx_cache_access_range(ctx, reinterpret_cast<std::uintptr_t>(dst_bytes), size, true,
+	                       hdr->access_hint());
+	for (std::size_t i = 0; i < size; ++i)
+		dst_bytes[i] = src_bytes[i];
+
+	return true;
+}
+
+// Resize an allocation, preferring in-place growth: a free physical
+// successor is absorbed before falling back to allocate-copy-free. The
+// relocation copy is simulated as one ranged read of the old payload and
+// one ranged write of the new one — the same traffic a memcpy generates —
+// instead of being replayed byte-wise through ctx_read/ctx_write.
+// Returns the (possibly new) block id, or -1 on failure; new_size == 0
+// frees the block.
+static int ctx_realloc(AllocatorContext &ctx, int id, std::size_t new_size, FitStrategy strategy)
+{
+	ctx_init(ctx);
+	if (id < 0)
+		return -1;
+	if (new_size == 0)
+	{
+		ctx_free(ctx, id);
+		return -1;
+	}
+
+	BlockHeader *hdr = find_block_by_id(ctx, id);
+	if (!hdr || hdr->free)
+		return -1;
+
+	std::size_t aligned_new = align_size(new_size);
+
+	if (ctx.engine == AllocEngine::Buddy)
+	{
+		// A buddy block's user area runs to the end of its chunk, so any
+		// request that still fits resizes in place; anything larger must
+		// relocate (chunks cannot stretch past their buddy boundary).
+		if (aligned_new <= hdr->size)
+		{
+			if (ctx.debug_fill && new_size > hdr->requested_size)
+				std::memset(hdr->start() + hdr->requested_size, PATTERN_UNINITIALIZED,
+				            new_size - hdr->requested_size);
+			else if (ctx.debug_fill && new_size < hdr->requested_size)
+				std::memset(hdr->start() + new_size, PATTERN_FREED,
+				            hdr->requested_size - new_size);
+			hdr->requested_size = new_size;
+			return id;
+		}
+	}
+	else if (aligned_new <= hdr->size)
+	{
+		// Shrink (or exact fit) in place; an oversized tail goes back to
+		// the heap as its own free block.
+		HeapShard &shard = shard_for_block(ctx, hdr);
+		std::lock_guard<std::mutex> guard(shard.lock);
+		std::size_t old_size = hdr->size;
+		split_block_if_needed(shard, hdr, aligned_new);
+		if (hdr->size != old_size)
+		{
+			BlockHeader *tail = hdr->next;
+			if (ctx.debug_fill)
+			{
+				// The fill would wipe the links split just filed; unhook,
+				// pattern, re-file.
+				free_list_remove(shard, tail);
+				std::memset(tail->start(), PATTERN_FREED, tail->size);
+				free_list_insert(shard, tail);
+			}
+			coalesce_with_neighbors(shard, tail);
+		}
+		hdr->requested_size = new_size;
+		return id;
+	}
+	else
+	{
+		// Grow in place by absorbing a free physical successor when it is
+		// large enough; the block keeps its id and address.
+		HeapShard &shard = shard_for_block(ctx, hdr);
+		std::lock_guard<std::mutex> guard(shard.lock);
+		BlockHeader *next = hdr->next;
+		if (next && next->free && block_end(hdr) == reinterpret_cast<std::uint8_t *>(next)
+		    && hdr->size + sizeof(BlockHeader) + next->size >= aligned_new)
+		{
+			free_list_remove(shard, next);
+			hdr->size += sizeof(BlockHeader) + next->size;
+			hdr->next = next->next;
+			if (hdr->next)
+				hdr->next->prev = hdr;
+			if (shard.tail == next)
+				shard.tail = hdr;
+			split_block_if_needed(shard, hdr, aligned_new);
+			if (ctx.debug_fill)
+				std::memset(hdr->start() + hdr->requested_size, PATTERN_UNINITIALIZED,
+				            hdr->size - hdr->requested_size);
+			hdr->requested_size = new_size;
+			return id;
+		}
+	}
+
+	// Relocate: fresh block, one simulated copy, old block freed.
+	int new_id = ctx_malloc(ctx, new_size, strategy);
+	if (new_id < 0)
+		return -1;
+	BlockHeader *dst = find_block_by_id(ctx, new_id);
+	std::size_t copy = (hdr->requested_size < new_size) ? hdr->requested_size : new_size;
+	if (copy != 0)
+	{
+		ctx_cache_access_range(ctx, reinterpret_cast<std::uintptr_t>(hdr->start()), copy, false,
+		                       hdr->access_hint());
+		ctx_cache_access_range(ctx, reinterpret_cast<std::uintptr_t>(dst->start()), copy, true,
+		                       dst->access_hint());
+		std::memcpy(dst->start(), hdr->start(), copy);
+	}
+	dst->set_access_hint(hdr->access_hint()); // hints survive relocation
+	ctx_free(ctx, id);
+	return new_id;
+}
+
+static std::uintptr_t align_up(std::uintptr_t value, std::size_t align)
+{
+	return (value + align - 1) & ~static_cast<std::uintptr_t>(align - 1);
+}
+
+// Allocate with a caller-chosen power-of-two alignment (cache lines,
+// pages). A block with alignment headroom is carved, the header is moved
+// up to just below the first aligned payload address, and the skipped
+// front region goes back to the heap as a free block.
+static int ctx_malloc_aligned(AllocatorContext &ctx, std::size_t size, std::size_t align,
+                              FitStrategy strategy)
+{
+	ctx_init(ctx);
+	if (size == 0 || align == 0 || (align & (align - 1)) != 0)
+		return -1;
+	if (align <= SMALL_ALIGN)
+		return ctx_malloc(ctx, size, strategy); // already guaranteed by align_size()
+	if (ctx.engine == AllocEngine::Buddy)
+		return buddy_alloc(ctx, size, align);
+
+	ctx.alloc_requests.fetch_add(1, std::memory_order_relaxed);
+	std::size_t payload = align_size(size);
+	// Headroom for the worst-case skew plus a minimal front free block.
+	std::size_t total = payload + align + sizeof(BlockHeader) + SMALL_ALIGN;
+	BlockHeader *block = carve_block(ctx, total, strategy);
+	if (!block)
+	{
+		ctx.alloc_fail.fetch_add(1, std::memory_order_relaxed);
+		return -1;
+	}
+
+	HeapShard &shard = shard_for_block(ctx, block);
+	{
+		std::lock_guard<std::mutex> guard(shard.lock);
+		std::uint8_t *base = reinterpret_cast<std::uint8_t *>(block);
+		std::uint8_t *end = block_end(block);
+		std::uintptr_t natural = reinterpret_cast<std::uintptr_t>(base + sizeof(BlockHeader));
+		std::uintptr_t user = align_up(natural, align);
+		// The front region must be able to hold a free block of its own.
+		while (user != natural
+		       && user - reinterpret_cast<std::uintptr_t>(base)
+		          < 2 * sizeof(BlockHeader) + sizeof(FreeLinks))
+			user += align;
+
+		if (user != natural)
+		{
+			// Move the header up to just below the aligned address; the
+			// original header shrinks into a free block covering the gap.
+			BlockHeader *moved = reinterpret_cast<BlockHeader *>(
+				reinterpret_cast<std::uint8_t *>(user) - sizeof(BlockHeader));
+			moved->id = -1;
+			moved->start_gap = 0;
+			moved->size = static_cast<std::size_t>(end - moved->start());
+			moved->requested_size = 0;
+			moved->free = false;
+			moved->set_access_hint(AccessHint::Uncacheable);
+			moved->next = block->next;
+			moved->prev = block;
+			if (moved->next)
+				moved->next->prev = moved;
+			if (shard.tail == block)
+				shard.tail = moved;
+
+			block->size = static_cast<std::size_t>(
+				reinterpret_cast<std::uint8_t *>(moved) - base - sizeof(BlockHeader));
+			block->requested_size = 0;
+			block->free = true;
+			block->next = moved;
+			free_list_insert(shard, block);
+			coalesce_with_neighbors(shard, block);
+			block = moved;
+		}
+		split_block_if_needed(shard, block, payload);
+	}
+
+	block->id = ctx.next_id.fetch_add(1, std::memory_order_relaxed);
+	block->set_access_hint(AccessHint::Normal);
+	block->requested_size = size;
+	{
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		id_map_insert(ctx, block->id, block);
+	}
+	if (ctx.debug_fill)
+		std::memset(block->start(), PATTERN_UNINITIALIZED, block->size);
+	ctx.alloc_success.fetch_add(1, std::memory_order_relaxed);
+	return block->id;
+}
+
+static void small_slot_flush_for(AllocatorContext &ctx); // defined with snapshot/restore
+
+// ----------------------------- Compaction ------------------------------- //
+//
+// All user access goes through ids, never raw pointers, so live blocks are
+// relocatable. Compaction slides them toward the start of each shard,
+// rewrites their headers' addresses and id-map entries, and merges the
+// vacated space into one trailing free region. Blocks held by small-object
+// caches (free == false, id == -1) cannot be moved — thread-local lists
+// point straight at them — so they act as pins; the calling thread's cache
+// is flushed first, which removes its pins entirely.
+
+// Append a block to the rebuilt list of a compacted shard.
+static void compact_append(HeapShard &shard, BlockHeader *&new_head,
+                           BlockHeader *&new_tail, BlockHeader *block)
+{
+	block->prev = new_tail;
+	block->next = nullptr;
+	if (new_tail)
+		new_tail->next = block;
+	else
+		new_head = block;
+	new_tail = block;
+}
+
+// Turn [addr, addr + len) into a single free block on the rebuilt list.
+static void compact_emit_free(AllocatorContext &ctx, HeapShard &shard,
+                              BlockHeader *&new_head, BlockHeader *&new_tail,
+                              std::uint8_t *addr, std::size_t len)
+{
+	if (len < sizeof(BlockHeader) + sizeof(FreeLinks))
+		return; // cannot happen for gaps formed from whole free blocks
+
+	BlockHeader *block = reinterpret_cast<BlockHeader *>(addr);
+	block->id = -1;
+	block->start_gap = 0;
+	block->size = len - sizeof(BlockHeader);
+	block->requested_size = 0;
+	block->free = true;
+	block->set_access_hint(AccessHint::Uncacheable);
+	compact_append(shard, new_head, new_tail, block);
+	// Pattern the payload before filing: the free-list links live in it.
+	if (ctx.debug_fill)
+		std::memset(block->start(), PATTERN_FREED, block->size);
+	free_list_insert(shard, block);
+}
+
+// Compact one context. max_move_bytes bounds how much payload is copied in
+// this invocation (0 = unbounded); once the budget is spent the remaining
+// blocks stay where they are, so repeated bounded calls converge without a
+// single long pause. Returns the number of bytes moved.
+static std::size_t ctx_compact(AllocatorContext &ctx, std::size_t max_move_bytes)
+{
+	ctx_init(ctx);
+	if (ctx.engine == AllocEngine::Buddy)
+		return 0; // chunk addresses are fixed by the buddy math
+	small_slot_flush_for(ctx);
+
+	std::size_t moved_total = 0;
+	bool budget_spent = false;
+
+	for (std::size_t s = 0; s < ctx.num_shards; ++s)
+	{
+		HeapShard &shard = ctx.shards[s];
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		BlockHeader *new_head = nullptr;
+		BlockHeader *new_tail = nullptr;
+		std::uint8_t *write_ptr = shard.base;
+
+		BlockHeader *curr = shard.head;
+		while (curr)
+		{
+			BlockHeader *next = curr->next;
+
+			if (curr->free)
+			{
+				// Its space folds into the current gap.
+				free_list_remove(shard, curr);
+				curr = next;
+				continue;
+			}
+
+			bool pinned = (curr->id == -1) || budget_spent;
+			std::uint8_t *curr_addr = reinterpret_cast<std::uint8_t *>(curr);
+			std::size_t span = sizeof(BlockHeader) + curr->size;
+
+			if (pinned || curr_addr == write_ptr)
+			{
+				// Leave in place; the gap before it becomes a free block.
+				compact_emit_free(ctx, shard, new_head, new_tail, write_ptr,
+				                  static_cast<std::size_t>(curr_addr - write_ptr));
+				compact_append(shard, new_head, new_tail, curr);
+				write_ptr = curr_addr + span;
+			}
+			else
+			{
+				std::memmove(write_ptr, curr_addr, span);
+				BlockHeader *moved = reinterpret_cast<BlockHeader *>(write_ptr);
+				compact_append(shard, new_head, new_tail, moved);
+				{
+					std::lock_guard<std::mutex> map_guard(ctx.id_map_lock);
+					IdMapEntry *entry = id_map_lookup(ctx, moved->id);
+					if (entry)
+						entry->block = moved;
+				}
+				moved_total += span;
+				write_ptr += span;
+				if (max_move_bytes != 0 && moved_total >= max_move_bytes)
+					budget_spent = true;
+			}
+
+			curr = next;
+		}
+
+		// Everything vacated ends up as one trailing free region.
+		compact_emit_free(ctx, shard, new_head, new_tail, write_ptr,
+		                  static_cast<std::size_t>(shard.base + shard.size - write_ptr));
+		shard.head = new_head;
+		shard.tail = new_tail;
+	}
+
+	return moved_total;
+}
+
+// Compact the default context. Quiescent points only: relocation moves
+// payload out from under any concurrent reader. max_move_bytes == 0 means
+// unbounded; a positive budget bounds the pause per invocation.
+std::size_t allocator_compact(std::size_t max_move_bytes)
+{
+	return ctx_compact(g_default_context, max_move_bytes);
+}
+
+static AllocatorStatsSnapshot ctx_collect_stats(AllocatorContext &ctx)
+{
+	ctx_init(ctx);
+	AllocatorStatsSnapshot s = {};
+	s.alloc_requests = ctx.alloc_requests.load(std::memory_order_relaxed);
+	s.alloc_success = ctx.alloc_success.load(std::memory_order_relaxed);
+	s.alloc_fail = ctx.alloc_fail.load(std::memory_order_relaxed);
+	s.small_hits = ctx.small_hits.load(std::memory_order_relaxed);
+	s.small_fills = ctx.small_fills.load(std::memory_order_relaxed);
+	s.small_flushes = ctx.small_flushes.load(std::memory_order_relaxed);
+
+	for (std::size_t i = 0; i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		s.heap_size += shard.size;
+		for (BlockHeader *curr = shard.head; curr; curr = curr->next)
+		{
+			if (curr->free)
+			{
+				++s.free_blocks;
+				s.total_free += curr->size;
+				if (curr->size > s.largest_free_block)
+					s.largest_free_block = curr->size;
+			}
+			else if (curr->id == -1)
+			{
+				// Held by the small-object cache: neither live nor reusable by
+				// other size classes, so track it separately.
+				++s.small_cached_blocks;
+				s.small_cached_bytes += curr->size;
+			}
+			else
+			{
+				++s.used_blocks;
+				s.total_used += curr->size;
+				if (curr->size > curr->requested_size)
+					s.internal_frag_bytes += (curr->size - curr->requested_size);
+			}
+		}
+	}
+
+	s.utilization_pct = (s.heap_size != 0)
+		                    ? (100.0 * static_cast<double>(s.total_used) / static_cast<double>(s.heap_size))
+		                    : 0.0;
+	s.internal_frag_pct = (s.total_used != 0)
+		                      ? (100.0 * static_cast<double>(s.internal_frag_bytes) / static_cast<double>(s.total_used))
+		                      : 0.0;
+	s.external_frag_pct = 0.0;
+	if (s.total_free != 0 && s.largest_free_block != 0)
+	{
+		s.external_frag_pct = 100.0 * (1.0 - static_cast<double>(s.largest_free_block) / static_cast<double>(s.total_free));
+	}
+
+	return s;
+}
+
+// -------------------------- Public context API -------------------------- //
+//
+// A context is an independent allocator+cache instance. Contexts are fully
+// thread-safe internally, but destroy() must not race with use.
+
+AllocatorContext *allocator_context_create(std::size_t heap_size, std::size_t shards)
+{
+	AllocatorContext *ctx = new AllocatorContext();
+	if (heap_size > 0xFFFFFFFFull)
+		heap_size = 0xFFFFFFFFull; // block sizes are 32-bit in the packed header
+	if (heap_size >= sizeof(BlockHeader) + 64)
+		ctx->heap_size_config = heap_size;
+	if (shards >= 1 && shards <= MAX_SHARDS)
+		ctx->num_shards = shards;
+	return ctx;
+}
+
+void allocator_context_destroy(AllocatorContext *ctx)
+{
+	if (!ctx || ctx == &g_default_context)
+		return;
+	// Drop the calling thread's small cache for this context; other
+	// threads' slots become stale and are skipped via the registry.
+	SmallCacheSlot &slot = small_slot_for(*ctx);
+	for (std::size_t c = 0; c < NUM_SMALL_CLASSES; ++c)
+	{
+		slot.lists[c] = nullptr;
+		slot.counts[c] = 0;
+	}
+	slot.ctx_id = 0;
+	slot.ctx = nullptr;
+	ctx_registry_remove(ctx->ctx_id);
+	arena_release(*ctx);
+	delete[] ctx->id_map;
+	delete ctx;
+}
+
+int allocator_ctx_malloc(AllocatorContext *ctx, std::size_t size, FitStrategy strategy)
+{
+	return ctx_malloc(*ctx, size, strategy);
+}
+
+void allocator_ctx_free(AllocatorContext *ctx, int id)
+{
+	ctx_free(*ctx, id);
+}
+
+bool allocator_ctx_read(AllocatorContext *ctx, int id, std::size_t offset, void *dst, std::size_t size)
+{
+	return ctx_read(*ctx, id, offset, dst, size);
+}
+
+bool allocator_ctx_write(AllocatorContext *ctx, int id, std::size_t offset, const void *src, std::size_t size)
+{
+	return ctx_write(*ctx, id, offset, src, size);
+}
+
+AllocatorStatsSnapshot allocator_ctx_collect_stats(AllocatorContext *ctx)
+{
+	return ctx_collect_stats(*ctx);
+}
+
+// Aggregate cache counters of a context's hierarchy, for side-by-side
+// strategy comparisons.
+void allocator_ctx_cache_totals(AllocatorContext *ctx, std::uint64_t &accesses,
+                                std::uint64_t &hits, std::uint64_t &total_penalty)
+{
+	ctx_init(*ctx);
+	std::lock_guard<std::mutex> guard(*ctx->cache_lock);
+	accesses = ctx->cache->total_accesses();
+	hits = ctx->cache->total_hits();
+	total_penalty = ctx->cache->total_penalty();
+}
+
+// ------------------- Classic API (default context) ---------------------- //
+
+static FitStrategy g_current_strategy = FitStrategy::First; // Global allocation strategy.
+
+static void sample_tick(); // interval stats sampler (defined below)
+
+void allocator_set_debug_fill(bool enabled)
+{
+	g_default_context.debug_fill = enabled;
+}
+
+// Set the heap size used at (re)initialization. Only effective before the
+// first allocation or after allocator_reset().
+void allocator_set_heap_size(std::size_t bytes)
+{
+	if (g_default_context.initialized.load(std::memory_order_acquire))
+		return; // heap already laid out; too late to resize
+	if (bytes < sizeof(BlockHeader) + 64)
+		bytes = sizeof(BlockHeader) + 64;
+	if (bytes > 0xFFFFFFFFull)
+		bytes = 0xFFFFFFFFull; // block sizes are 32-bit in the packed header
+	HEAP_SIZE = bytes;
+}
+
+// Set the number of heap shards for concurrent use (default 1). Only
+// effective before the first allocation or after allocator_reset().
+void allocator_set_shards(std::size_t shards)
+{
+	if (g_default_context.initialized.load(std::memory_order_acquire))
+		return;
+	if (shards < 1)
+		shards = 1;
+	if (shards > MAX_SHARDS)
+		shards = MAX_SHARDS;
+	g_default_context.num_shards = shards;
+}
+
+// Select the allocation engine backing the classic API: the list-based
+// fit allocator ("list", the default) or the binary buddy system
+// ("buddy"). Only effective before the first allocation or after
+// allocator_reset().
+void allocator_set_engine(const std::string &engine)
+{
+	if (g_default_context.initialized.load(std::memory_order_acquire))
+		return;
+	if (engine == "buddy")
+		g_default_context.engine = AllocEngine::Buddy;
+	else if (engine == "list")
+		g_default_context.engine = AllocEngine::List;
+}
+
+void allocator_init()
+{
+	ctx_init(g_default_context);
+}
+
+// Allocate a block of memory of given size using a fit strategy.
+// Returns an integer handle identifying the block.
+int allocator_malloc(std::size_t size, FitStrategy strategy)
+{
+	std::uint64_t t0 = op_time_now();
+	int id = ctx_malloc(g_default_context, size, strategy);
+	op_time_record(TimedOp::Malloc, t0);
+	sample_tick();
+	return id;
+}
+
+// Convenience overload: strategy as a string ("first", "best", "worst").
+int allocator_malloc(std::size_t size, const std::string &strategy)
+{
+    FitStrategy strat = parse_strategy(strategy);
+	return allocator_malloc(size, strat);
+}
+
+// Backward-compatible default: first-fit.
+int allocator_malloc(std::size_t size)
+{
+	return allocator_malloc(size, g_current_strategy);
+}
+
+// Change the global allocation strategy used by allocator_malloc(size).
+void allocator_set_strategy(FitStrategy strategy)
+{
+	g_current_strategy = strategy;
+}
+
+// Resize a block, growing in place when the physical successor is free.
+// Returns the (possibly new) id, or -1 on failure; new_size == 0 frees.
+int allocator_realloc(int id, std::size_t new_size)
+{
+	int result = ctx_realloc(g_default_context, id, new_size, g_current_strategy);
+	sample_tick();
+	return result;
+}
+
+// Allocate with a power-of-two alignment (e.g. 64 for cache lines, 4096
+// for pages).
+int allocator_malloc_aligned(std::size_t size, std::size_t align, FitStrategy strategy)
+{
+	int id = ctx_malloc_aligned(g_default_context, size, align, strategy);
+	sample_tick();
+	return id;
+}
+
+int allocator_malloc_aligned(std::size_t size, std::size_t align)
+{
+	return allocator_malloc_aligned(size, align, g_current_strategy);
+}
+
+// Free a previously allocated block identified by id.
+void allocator_free(int id)
+{
+	std::uint64_t t0 = op_time_now();
+	ctx_free(g_default_context, id);
+	op_time_record(TimedOp::Free, t0);
+	sample_tick();
+}
+
+// Set a block's cache placement hint. Allocations start as Normal;
+// Streaming marks a block's traffic non-temporal (uses resident lines but
+// never fills any, so it cannot evict the working set); Uncacheable sends
+// it straight to memory.
+void allocator_set_block_hint(int id, AccessHint hint)
+{
+	allocator_init();
+	if (id < 0)
+		return;
+	BlockHeader *hdr = find_block_by_id(g_default_context, id);
+	if (!hdr || hdr->free)
+		return;
+	hdr->set_access_hint(hint);
+}
+
+// String overload ("normal", "streaming"/"nt", "uncacheable"/"uc").
+// Returns false for an unknown hint name.
+bool allocator_set_block_hint(int id, const std::string &hint)
+{
+	if (hint == "normal")
+		allocator_set_block_hint(id, AccessHint::Normal);
+	else if (hint == "streaming" || hint == "non-temporal" || hint == "nt")
+		allocator_set_block_hint(id, AccessHint::Streaming);
+	else if (hint == "uncacheable" || hint == "uc")
+		allocator_set_block_hint(id, AccessHint::Uncacheable);
+	else
+		return false;
+	return true;
+}
+
+// Backward-compatible boolean form: maps onto Normal/Uncacheable.
+void allocator_set_block_cacheable(int id, bool cacheable)
+{
+	allocator_set_block_hint(id, cacheable ? AccessHint::Normal : AccessHint::Uncacheable);
+}
+
+// Simulate an access to a block through the cache hierarchy, honoring
+// the block's placement hint (uncacheable traffic is still simulated —
+// it charges memory latency — it just bypasses every level).
+void allocator_access(int id, bool is_write)
+{
+	allocator_init();
+	if (id < 0)
+		return;
+	AllocatorContext &ctx = g_default_context;
+	std::uintptr_t addr = 0;
+	AccessHint hint = AccessHint::Normal;
+	{
+		// The per-block access count lives in the id-map entry, not the header.
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		IdMapEntry *entry = id_map_lookup(ctx, id);
+		if (!entry)
+			return;
+		addr = reinterpret_cast<std::uintptr_t>(entry->block->start());
+		hint = entry->block->access_hint();
+		++entry->cache_hits;
+	}
+	ctx_cache_access(ctx, addr, is_write, hint);
+}
+
+// Read from an allocated block into user-provided buffer.
+// Returns false if the id/range is invalid or if the range contains
+// bytes that look like uninitialized/freed ("garbage") data.
+bool allocator_read(int id, std::size_t offset, void *dst, std::size_t size)
+{
+	std::uint64_t t0 = op_time_now();
+	bool ok = ctx_read(g_default_context, id, offset, dst, size);
+	op_time_record(TimedOp::Read, t0);
+	sample_tick();
+	return ok;
+}
+
+// Write to an allocated block from user-provided buffer.
+// Returns false if the id/range is invalid or if the destination range
+// currently contains bytes that look like uninitialized/freed
+// ("garbage") data.
+bool allocator_write(int id, std::size_t offset, const void *src, std::size_t size)
+{
+	std::uint64_t t0 = op_time_now();
+	bool ok = ctx_write(g_default_context, id, offset, src, size);
+	op_time_record(TimedOp::Write, t0);
+	sample_tick();
+	return ok;
+}
+
+// Dump allocator state to stdout.
+// NOTE: mainn.cpp can provide the printing; this exists for parity with the sample.
+#include <iostream>
+void allocator_dump()
+{
+	allocator_init();
+	AllocatorContext &ctx = g_default_context;
+	std::cout << "Heap dump (block list):\n";
+	std::size_t index = 0;
+	for (std::size_t s = 0; s < ctx.num_shards; ++s)
+	{
+		HeapShard &shard = ctx.shards[s];
+		std::lock_guard<std::mutex> guard(shard.lock);
+		if (ctx.num_shards > 1)
+			std::cout << "  Shard " << s << ":\n";
+		for (BlockHeader *curr = shard.head; curr; curr = curr->next)
+		{
+			std::uint8_t *base = reinterpret_cast<std::uint8_t *>(curr);
+			std::size_t offset = static_cast<std::size_t>(base - ctx.heap);
+			std::uint32_t hits = 0;
+			if (curr->id >= 0)
+			{
+				std::lock_guard<std::mutex> map_guard(ctx.id_map_lock);
+				IdMapEntry *entry = id_map_lookup(ctx, curr->id);
+				if (entry)
+					hits = entry->cache_hits;
+			}
+			std::cout << "  Block " << index++
+					  << ": offset=" << offset
+					  << ", id=" << curr->id
+					  << ", start=" << static_cast<void *>(curr->start())
+					  << ", size=" << curr->size
+					  << ", " << (curr->free ? "FREE" : (curr->id == -1 ? "CACHED" : "USED"))
+					  << ", hint=" << access_hint_name(curr->access_hint())
+					  << ", cache_hits=" << hits
+					  << "\n";
+		}
+	}
+
+    std :: cout << sizeof(BlockHeader) << " bytes per block header\n";
+}
+
+AllocatorStatsSnapshot allocator_collect_stats()
+{
+	return ctx_collect_stats(g_default_context);
+}
+
+// Reset the default context (and global cache) to a pristine state.
+// Benchmark drivers use this to run several isolated workloads in one
+// process. Not thread-safe: no other thread may be using the allocator,
+// and any other thread's small-object cache contents are abandoned with
+// the old arena.
+void allocator_reset()
+{
+	AllocatorContext &ctx = g_default_context;
+	ctx_registry_remove(ctx.ctx_id);
+	arena_release(ctx);
+	g_heap = nullptr;
+	for (std::size_t i = 0; i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		shard.head = nullptr;
+		shard.tail = nullptr;
+		shard.base = nullptr;
+		shard.size = 0;
+		shard.reserved = 0;
+		for (std::size_t c = 0; c < NUM_SIZE_CLASSES; ++c)
+			shard.free_lists[c] = nullptr;
+	}
+	ctx.next_id.store(0, std::memory_order_relaxed);
+	ctx.alloc_requests.store(0, std::memory_order_relaxed);
+	ctx.alloc_success.store(0, std::memory_order_relaxed);
+	ctx.alloc_fail.store(0, std::memory_order_relaxed);
+	// Give the default context a fresh identity so this thread's (and any
+	// other thread's) cached small blocks can never be handed out again.
+	ctx.ctx_id = g_ctx_id_gen.fetch_add(1, std::memory_order_relaxed);
+	ctx.small_hits.store(0, std::memory_order_relaxed);
+	ctx.small_fills.store(0, std::memory_order_relaxed);
+	ctx.small_flushes.store(0, std::memory_order_relaxed);
+	delete[] ctx.id_map;
+	ctx.id_map = nullptr;
+	ctx.id_map_capacity = 0;
+	ctx.id_map_used = 0;
+	ctx.cache_initialized = false; // ctx_init() re-creates the default cache
+	ctx.initialized.store(false, std::memory_order_release);
+}
+
+// ----------------------- Stats export / sampling ------------------------- //
+//
+// Machine-readable views of the same counters allocator_stats() prints, so
+// harnesses stop scraping stdout text: a one-shot JSON object, and an
+// interval sampler that appends one compact record (CSV or JSON lines) per
+// N operations to a file through buffered stream I/O. Fragmentation-over-
+// time curves come from plotting the sampling file directly.
+
+static void stats_write_json(std::ostream &os, const AllocatorStatsSnapshot &s)
+{
+	os << "{\"heap_size\":" << s.heap_size
+	   << ",\"used_bytes\":" << s.total_used
+	   << ",\"free_bytes\":" << s.total_free
+	   << ",\"used_blocks\":" << s.used_blocks
+	   << ",\"free_blocks\":" << s.free_blocks
+	   << ",\"internal_frag_bytes\":" << s.internal_frag_bytes
+	   << ",\"largest_free_block\":" << s.largest_free_block
+	   << ",\"alloc_requests\":" << s.alloc_requests
+	   << ",\"alloc_success\":" << s.alloc_success
+	   << ",\"alloc_fail\":" << s.alloc_fail
+	   << ",\"small_cached_blocks\":" << s.small_cached_blocks
+	   << ",\"small_cached_bytes\":" << s.small_cached_bytes
+	   << ",\"small_hits\":" << s.small_hits
+	   << ",\"small_fills\":" << s.small_fills
+	   << ",\"small_flushes\":" << s.small_flushes
+	   << ",\"utilization_pct\":" << s.utilization_pct
+	   << ",\"internal_frag_pct\":" << s.internal_frag_pct
+	   << ",\"external_frag_pct\":" << s.external_frag_pct
+	   << ",\"cache\":";
+	cache_write_json(os);
+	os << "}";
+}
+
+// Full allocator + cache state as one JSON object.
+std::string allocator_stats_json()
+{
+	std::ostringstream os;
+	stats_write_json(os, allocator_collect_stats());
+	return os.str();
+}
+
+// Interval sampler state. Writes happen under g_sample_lock; the op
+// counter is atomic so the fast path in the classic API is one increment.
+static std::ofstream g_sample_out;
+static std::mutex g_sample_lock;
+static std::atomic<std::uint64_t> g_sample_ops{0};
+static std::size_t g_sample_interval = 0; // 0 => sampling off
+static bool g_sample_csv = true;
+
+static void sample_write_record(std::uint64_t op_count)
+{
+	AllocatorStatsSnapshot s = allocator_collect_stats();
+	if (g_sample_csv)
+	{
+		g_sample_out << op_count << "," << s.heap_size << "," << s.total_used << ","
+		             << s.total_free << "," << s.used_blocks << "," << s.free_blocks << ","
+		             << s.internal_frag_pct << "," << s.external_frag_pct << ","
+		             << s.utilization_pct << "," << s.alloc_requests << ","
+		             << s.alloc_success << "," << s.alloc_fail << ",";
+		cache_write_csv_fields(g_sample_out);
+		g_sample_out << "\n";
+	}
+	else
+	{
+		g_sample_out << "{\"op\":" << op_count << ",\"stats\":";
+		stats_write_json(g_sample_out, s);
+		g_sample_out << "}\n";
+	}
+}
+
+// Start appending one record per `interval` operations to `path`.
+// csv=false selects JSON-lines output. Returns false if the file cannot
+// be opened.
+bool allocator_set_sampling(const char *path, std::size_t interval, bool csv)
+{
+	std::lock_guard<std::mutex> guard(g_sample_lock);
+	if (g_sample_out.is_open())
+		g_sample_out.close();
+	if (!path || interval == 0)
+	{
+		g_sample_interval = 0;
+		return true;
+	}
+
+	g_sample_out.open(path, std::ios::out | std::ios::trunc);
+	if (!g_sample_out.is_open())
+	{
+		g_sample_interval = 0;
+		return false;
+	}
+	g_sample_csv = csv;
+	g_sample_interval = interval;
+	g_sample_ops.store(0, std::memory_order_relaxed);
+	if (csv)
+	{
+		g_sample_out << "op,heap_size,used_bytes,free_bytes,used_blocks,free_blocks,"
+		             << "int_frag_pct,ext_frag_pct,util_pct,requests,success,fail,";
+		cache_write_csv_header(g_sample_out);
+		g_sample_out << "\n";
+	}
+	return true;
+}
+
+void allocator_stop_sampling()
+{
+	std::lock_guard<std::mutex> guard(g_sample_lock);
+	g_sample_interval = 0;
+	if (g_sample_out.is_open())
+		g_sample_out.close();
+}
+
+// Set how the default context feeds the cache simulator: "off" skips it,
+// "full" simulates every access, "sampled" simulates every `interval`-th
+// access and scales the reported counters by the interval so they remain
+// estimates of the full stream. Returns false for an unknown mode. The
+// setting is a run parameter, not state: snapshots do not carry it.
+bool allocator_set_cache_sim(const std::string &mode, std::size_t interval)
+{
+	AllocatorContext &ctx = g_default_context;
+
+	if (mode == "off")
+	{
+		ctx.cache_sim_mode = CacheSimMode::Off;
+		interval = 1;
+	}
+	else if (mode == "full")
+	{
+		ctx.cache_sim_mode = CacheSimMode::Full;
+		interval = 1;
+	}
+	else if (mode == "sampled")
+	{
+		ctx.cache_sim_mode = CacheSimMode::Sampled;
+		if (interval < 2)
+			interval = 64; // default sampling period
+	}
+	else
+	{
+		return false;
+	}
+
+	ctx.cache_sim_interval = interval;
+	ctx.cache_sim_counter.store(0, std::memory_order_relaxed);
+	if (ctx.initialized.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> guard(*ctx.cache_lock);
+		ctx.cache->set_sample_scale(interval);
+	}
+	return true;
+}
+
+// Called after each classic-API operation on the default context.
+static void sample_tick()
+{
+	if (g_sample_interval == 0)
+		return;
+	std::uint64_t n = g_sample_ops.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (n % g_sample_interval != 0)
+		return;
+	std::lock_guard<std::mutex> guard(g_sample_lock);
+	if (g_sample_interval != 0 && g_sample_out.is_open())
+		sample_write_record(n);
+}
+
+// ------------------------ Snapshot / restore ----------------------------- //
+//
+// Checkpoint the default context (heap contents, block metadata, counters)
+// and the global cache to a file, so a long replay can resume from the
+// checkpoint instead of re-simulating its whole prefix. Pointers inside the
+// heap image are stored as-is along with the old arena base; restore rebases
+// them against the new mapping. Single-threaded by design: other threads'
+// small-object caches cannot be flushed from here, so checkpoint only from
+// quiescent points (e.g. between trace batches).
+
+static constexpr std::uint64_t SNAPSHOT_MAGIC = 0x414C53494D534E50ull; // "ALSIMSNP"
+
+static std::uint64_t snapshot_encode_ptr(AllocatorContext &ctx, const void *ptr)
+{
+	if (!ptr)
+		return ~0ull;
+	return static_cast<std::uint64_t>(static_cast<const std::uint8_t *>(ptr) - ctx.heap);
+}
+
+static BlockHeader *snapshot_decode_ptr(AllocatorContext &ctx, std::uint64_t offset)
+{
+	if (offset == ~0ull)
+		return nullptr;
+	return reinterpret_cast<BlockHeader *>(ctx.heap + offset);
+}
+
+// Flush the calling thread's small-object cache for ctx so every block is
+// reachable through the shard block lists before serialization.
+static void small_slot_flush_for(AllocatorContext &ctx)
+{
+	for (std::size_t i = 0; i < MAX_THREAD_CTX_CACHES; ++i)
+		if (t_small_slots[i].ctx_id == ctx.ctx_id)
+			small_slot_flush_all(t_small_slots[i]);
+}
+
+bool allocator_snapshot(const char *path)
+{
+	AllocatorContext &ctx = g_default_context;
+	ctx_init(ctx);
+	small_slot_flush_for(ctx);
+
+	std::FILE *fp = std::fopen(path, "wb");
+	if (!fp)
+		return false;
+
+	bool ok = true;
+	std::uint64_t header[6] = {
+		SNAPSHOT_MAGIC,
+		static_cast<std::uint64_t>(ctx.heap_size_config),
+		static_cast<std::uint64_t>(ctx.num_shards),
+		static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(ctx.heap)),
+		static_cast<std::uint64_t>(ctx.shard_stride),
+		static_cast<std::uint64_t>(ctx.next_id.load(std::memory_order_relaxed))};
+	ok = ok && std::fwrite(header, sizeof(header), 1, fp) == 1;
+
+	std::uint8_t flags[3] = {
+		static_cast<std::uint8_t>(ctx.debug_fill ? 1 : 0),
+		static_cast<std::uint8_t>(ctx.current_strategy),
+		static_cast<std::uint8_t>(ctx.engine)};
+	ok = ok && std::fwrite(flags, sizeof(flags), 1, fp) == 1;
+
+	std::uint64_t counters[6] = {
+		ctx.alloc_requests.load(std::memory_order_relaxed),
+		ctx.alloc_success.load(std::memory_order_relaxed),
+		ctx.alloc_fail.load(std::memory_order_relaxed),
+		ctx.small_hits.load(std::memory_order_relaxed),
+		ctx.small_fills.load(std::memory_order_relaxed),
+		ctx.small_flushes.load(std::memory_order_relaxed)};
+	ok = ok && std::fwrite(counters, sizeof(counters), 1, fp) == 1;
+
+	for (std::size_t i = 0; ok && i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		std::uint64_t shard_header[3] = {
+			static_cast<std::uint64_t>(shard.size),
+			snapshot_encode_ptr(ctx, shard.head),
+			snapshot_encode_ptr(ctx, shard.tail)};
+		ok = ok && std::fwrite(shard_header, sizeof(shard_header), 1, fp) == 1;
+
+		std::uint64_t free_offsets[NUM_SIZE_CLASSES];
+		for (std::size_t c = 0; c < NUM_SIZE_CLASSES; ++c)
+			free_offsets[c] = snapshot_encode_ptr(ctx, shard.free_lists[c]);
+		ok = ok && std::fwrite(free_offsets, sizeof(free_offsets), 1, fp) == 1;
+
+		// Raw shard image: headers and payloads together.
+		ok = ok && std::fwrite(shard.base, 1, shard.size, fp) == shard.size;
+	}
+
+	// Per-block cache-hit counters live in the id map, not in the heap
+	// image, so they are serialized as (id, hits) pairs.
+	if (ok)
+	{
+		std::lock_guard<std::mutex> guard(ctx.id_map_lock);
+		std::uint64_t live = 0;
+		for (std::size_t i = 0; i < ctx.id_map_capacity; ++i)
+			if (ctx.id_map[i].id >= 0)
+				++live;
+		ok = std::fwrite(&live, sizeof(live), 1, fp) == 1;
+		for (std::size_t i = 0; ok && i < ctx.id_map_capacity; ++i)
+		{
+			if (ctx.id_map[i].id < 0)
+				continue;
+			std::uint32_t record[2] = {static_cast<std::uint32_t>(ctx.id_map[i].id),
+			                           ctx.id_map[i].cache_hits};
+			ok = std::fwrite(record, sizeof(record), 1, fp) == 1;
+		}
+	}
+
+	ok = ok && cache_save(fp);
+	std::fclose(fp);
+	return ok;
+}
+
+bool allocator_restore(const char *path)
+{
+	std::FILE *fp = std::fopen(path, "rb");
+	if (!fp)
+		return false;
+
+	std::uint64_t header[6];
+	std::uint8_t flags[3];
+	std::uint64_t counters[6];
+	if (std::fread(header, sizeof(header), 1, fp) != 1
+	    || header[0] != SNAPSHOT_MAGIC
+	    || header[2] < 1 || header[2] > MAX_SHARDS
+	    || std::fread(flags, sizeof(flags), 1, fp) != 1
+	    || std::fread(counters, sizeof(counters), 1, fp) != 1)
+	{
+		// A bad shard count (a truncated/corrupt file can carry a valid
+		// magic) would index past ctx.shards or divide by zero in the
+		// arena layout; reject it with the other header checks.
+		std::fclose(fp);
+		return false;
+	}
+
+	// Rebuild a pristine context with the snapshot's heap layout.
+	allocator_reset();
+	AllocatorContext &ctx = g_default_context;
+	HEAP_SIZE = static_cast<std::size_t>(header[1]);
+	ctx.num_shards = static_cast<std::size_t>(header[2]);
+	ctx.engine = static_cast<AllocEngine>(flags[2]);
+	ctx_init(ctx);
+
+	std::uint8_t *old_heap = reinterpret_cast<std::uint8_t *>(
+		static_cast<std::uintptr_t>(header[3]));
+	if (ctx.shard_stride != static_cast<std::size_t>(header[4]))
+	{
+		// The new reservation was laid out differently; offsets would not
+		// map back onto the same shards.
+		std::fclose(fp);
+		return false;
+	}
+
+	ctx.next_id.store(static_cast<int>(header[5]), std::memory_order_relaxed);
+	ctx.debug_fill = flags[0] != 0;
+	ctx.current_strategy = static_cast<FitStrategy>(flags[1]);
+	ctx.alloc_requests.store(counters[0], std::memory_order_relaxed);
+	ctx.alloc_success.store(counters[1], std::memory_order_relaxed);
+	ctx.alloc_fail.store(counters[2], std::memory_order_relaxed);
+	ctx.small_hits.store(counters[3], std::memory_order_relaxed);
+	ctx.small_fills.store(counters[4], std::memory_order_relaxed);
+	ctx.small_flushes.store(counters[5], std::memory_order_relaxed);
+
+	std::ptrdiff_t delta = ctx.heap - old_heap;
+	bool ok = true;
+
+	for (std::size_t i = 0; ok && i < ctx.num_shards; ++i)
+	{
+		HeapShard &shard = ctx.shards[i];
+		std::lock_guard<std::mutex> guard(shard.lock);
+
+		std::uint64_t shard_header[3];
+		std::uint64_t free_offsets[NUM_SIZE_CLASSES];
+		if (std::fread(shard_header, sizeof(shard_header), 1, fp) != 1
+		    || std::fread(free_offsets, sizeof(free_offsets), 1, fp) != 1
+		    || static_cast<std::size_t>(shard_header[0]) > shard.reserved)
+		{
+			ok = false;
+			break;
+		}
+
+		shard.size = static_cast<std::size_t>(shard_header[0]);
+		if (std::fread(shard.base, 1, shard.size, fp) != shard.size)
+		{
+			ok = false;
+			break;
+		}
+
+		shard.head = snapshot_decode_ptr(ctx, shard_header[1]);
+		shard.tail = snapshot_decode_ptr(ctx, shard_header[2]);
+		for (std::size_t c = 0; c < NUM_SIZE_CLASSES; ++c)
+			shard.free_lists[c] = snapshot_decode_ptr(ctx, free_offsets[c]);
+
+		// The copied headers still hold pointers into the old mapping;
+		// rebase them and rebuild the id map as we walk. The start gap is
+		// header-relative and needs no fixup; free-list links live in the
+		// payload of free blocks only.
+		for (BlockHeader *curr = shard.head; curr; curr = curr->next)
+		{
+			if (curr->next)
+				curr->next = reinterpret_cast<BlockHeader *>(
+					reinterpret_cast<std::uint8_t *>(curr->next) + delta);
+			if (curr->prev)
+				curr->prev = reinterpret_cast<BlockHeader *>(
+					reinterpret_cast<std::uint8_t *>(curr->prev) + delta);
+			if (curr->free)
+			{
+				FreeLinks &links = free_links(curr);
+				if (links.next)
+					links.next = reinterpret_cast<BlockHeader *>(
+						reinterpret_cast<std::uint8_t *>(links.next) + delta);
+				if (links.prev)
+					links.prev = reinterpret_cast<BlockHeader *>(
+						reinterpret_cast<std::uint8_t *>(links.prev) + delta);
+			}
+			if (curr->id >= 0)
+			{
+				std::lock_guard<std::mutex> map_guard(ctx.id_map_lock);
+				id_map_insert(ctx, curr->id, curr);
+			}
+		}
+	}
+
+	// Re-apply the serialized per-block cache-hit counters.
+	if (ok)
+	{
+		std::uint64_t live = 0;
+		ok = std::fread(&live, sizeof(live), 1, fp) == 1;
+		for (std::uint64_t n = 0; ok && n < live; ++n)
+		{
+			std::uint32_t record[2];
+			ok = std::fread(record, sizeof(record), 1, fp) == 1;
+			if (!ok)
+				break;
+			std::lock_guard<std::mutex> map_guard(ctx.id_map_lock);
+			IdMapEntry *entry = id_map_lookup(ctx, static_cast<int>(record[0]));
+			if (entry)
+				entry->cache_hits = record[1];
+		}
+	}
+
+	ok = ok && cache_load(fp);
+	// The restored tags encode addresses in the snapshot's mapping; shift
+	// them by the same delta the block pointers were rebased by, so lines
+	// hot at the checkpoint keep hitting instead of resuming cold (or
+	// falsely matching new-base addresses).
+	if (ok)
+		cache_rebase(static_cast<std::intptr_t>(delta));
+	std::fclose(fp);
+	return ok;
+}
+
+// Zero every per-operation host-timing histogram. Timing stays enabled —
+// only the accumulated samples are dropped, so a caller can bracket just
+// the phase it cares about.
+void allocator_reset_timing()
+{
+	for (std::size_t i = 0; i < TIMED_OP_COUNT; ++i)
+	{
+		OpTimeHistogram &h = g_op_times[i];
+		h.sum.store(0, std::memory_order_relaxed);
+		h.max.store(0, std::memory_order_relaxed);
+		for (std::size_t b = 0; b < TIMED_OP_BUCKETS; ++b)
+			h.buckets[b].store(0, std::memory_order_relaxed);
+	}
+}
+
+// Print the host-timing histograms: count, mean, p99 and max per
+// operation class. The p99 is the upper edge of the bucket holding the
+// 99th-percentile sample, clamped to the observed max.
+static void dump_op_times()
+{
+	std::cout << "  Per-operation host timing (" << op_time_unit() << "):\n";
+	bool any = false;
+	for (std::size_t i = 0; i < TIMED_OP_COUNT; ++i)
+	{
+		OpTimeHistogram &h = g_op_times[i];
+		std::uint64_t count = 0;
+		for (std::size_t b = 0; b < TIMED_OP_BUCKETS; ++b)
+			count += h.buckets[b].load(std::memory_order_relaxed);
+		if (count == 0)
+			continue;
+		any = true;
+		std::uint64_t sum = h.sum.load(std::memory_order_relaxed);
+		std::uint64_t max = h.max.load(std::memory_order_relaxed);
+		std::uint64_t target = (count * 99) / 100 + 1;
+		std::uint64_t cumulative = 0;
+		std::uint64_t p99 = max;
+		for (std::size_t b = 0; b < TIMED_OP_BUCKETS; ++b)
+		{
+			cumulative += h.buckets[b].load(std::memory_order_relaxed);
+			if (cumulative >= target)
+			{
+				std::uint64_t edge = (b >= 63)
+					? max
+					: (std::uint64_t(1) << (b + 1)) - 1;
+				p99 = (edge < max) ? edge : max;
+				break;
+			}
+		}
+		std::cout << "    " << std::left << std::setfill(' ') << std::setw(13)
+				  << timed_op_name(static_cast<TimedOp>(i)) << std::right
+				  << " count=" << count
+				  << " mean=" << static_cast<std::uint64_t>(
+						 static_cast<double>(sum) / static_cast<double>(count))
+				  << " p99<=" << p99
+				  << " max=" << max << "\n";
+	}
+	if (!any)
+		std::cout << "    (no timed operations yet)\n";
+}
+
+void allocator_stats()
+{
+	AllocatorStatsSnapshot s = allocator_collect_stats();
+
+	double success_rate = 0.0;
+	double failure_rate = 0.0;
+	if (s.alloc_requests != 0)
+	{
+		success_rate = 100.0 * static_cast<double>(s.alloc_success) / static_cast<double>(s.alloc_requests);
+		failure_rate = 100.0 * static_cast<double>(s.alloc_fail) / static_cast<double>(s.alloc_requests);
+	}
+
+	std::cout << "Allocator stats:\n";
+	std::cout << "  Heap size: " << s.heap_size << " bytes";
+	if (g_default_context.num_shards > 1)
+		std::cout << " across " << g_default_context.num_shards << " shard(s)";
+	std::cout << "\n";
+	std::cout << "  Used:      " << s.total_used << " bytes in " << s.used_blocks << " block(s)\n";
+	std::cout << "  Free:      " << s.total_free << " bytes in " << s.free_blocks << " block(s)\n";
+	std::cout << "  Internal fragmentation: " << s.internal_frag_bytes << " bytes (" << s.internal_frag_pct << "%)\n";
+	std::cout << "  External fragmentation: " << s.external_frag_pct << "%\n";
+	std::cout << "  Largest free block:     " << s.largest_free_block << " bytes\n";
+	std::cout << "  Allocation requests:    " << s.alloc_requests << "\n";
+	std::cout << "    Success:              " << s.alloc_success << " (" << success_rate << "%)\n";
+	std::cout << "    Failures:             " << s.alloc_fail << " (" << failure_rate << "%)\n";
+	std::cout << "  Memory utilization:     " << s.utilization_pct << "% of heap\n";
+	std::cout << "  Small-object cache:     " << s.small_cached_bytes << " bytes in "
+			  << s.small_cached_blocks << " block(s), hits=" << s.small_hits
+			  << ", fills=" << s.small_fills << ", flushes=" << s.small_flushes << "\n";
+	dump_op_times();
+
+	// Dump cache stats as well.
+	std ::cout << "\nCache statistics:\n";
+	cache_dump_stats();
+}
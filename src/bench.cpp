@@ -0,0 +1,168 @@
+// Benchmark driver for the custom allocator.
+// Build with `make bench`, run as:
+//   ./bench [ops_per_workload] [strategy]
+//
+// Generates standard synthetic alloc/free workloads and reports, per
+// workload: ops/sec, p50/p99/max per-operation latency, and the final
+// fragmentation numbers from the same counters allocator_stats() uses.
+//
+// Workloads:
+//   uniform           - sizes uniform in [16, 256], random-victim frees
+//   bimodal           - 90% small (16-64), 10% large (1024-4096)
+//   ramp              - request sizes grow linearly over the run
+//   producer-consumer - FIFO lifetime: always free the oldest live block
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include "allocator.hpp"
+
+static constexpr std::size_t BENCH_HEAP_SIZE = 8 * 1024 * 1024; // 8 MB bench heap
+
+// Deterministic xorshift64 PRNG so runs are reproducible across builds.
+static std::uint64_t g_rng_state = 0x9E3779B97F4A7C15ull;
+
+static std::uint64_t rng_next()
+{
+	std::uint64_t x = g_rng_state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	g_rng_state = x;
+	return x;
+}
+
+static std::size_t rng_range(std::size_t lo, std::size_t hi)
+{
+	return lo + static_cast<std::size_t>(rng_next() % (hi - lo + 1));
+}
+
+enum class Workload
+{
+	Uniform,
+	Bimodal,
+	Ramp,
+	ProducerConsumer,
+};
+
+static const char *workload_name(Workload w)
+{
+	switch (w)
+	{
+	case Workload::Uniform: return "uniform";
+	case Workload::Bimodal: return "bimodal";
+	case Workload::Ramp: return "ramp";
+	case Workload::ProducerConsumer: return "producer-consumer";
+	}
+	return "?";
+}
+
+static std::size_t next_size(Workload w, std::size_t op, std::size_t total_ops)
+{
+	switch (w)
+	{
+	case Workload::Uniform:
+		return rng_range(16, 256);
+	case Workload::Bimodal:
+		return (rng_next() % 10 == 0) ? rng_range(1024, 4096) : rng_range(16, 64);
+	case Workload::Ramp:
+		// Grow linearly from 16 to ~1024 bytes over the run.
+		return 16 + (op * 1008) / (total_ops ? total_ops : 1);
+	case Workload::ProducerConsumer:
+		return rng_range(32, 128);
+	}
+	return 64;
+}
+
+static void run_workload(Workload w, std::size_t total_ops, FitStrategy strategy)
+{
+	allocator_reset();
+	allocator_set_heap_size(BENCH_HEAP_SIZE);
+	g_rng_state = 0x9E3779B97F4A7C15ull;
+
+	const std::size_t max_live = 2000;
+	std::vector<int> live;
+	live.reserve(max_live + 1);
+	std::vector<std::uint32_t> latencies_ns;
+	latencies_ns.reserve(total_ops);
+
+	using clock = std::chrono::steady_clock;
+	auto t_start = clock::now();
+
+	for (std::size_t op = 0; op < total_ops; ++op)
+	{
+		// Free when the live set is full, or randomly ~1/3 of the time.
+		bool do_free = !live.empty() && (live.size() >= max_live || rng_next() % 3 == 0);
+
+		auto t0 = clock::now();
+		if (do_free)
+		{
+			std::size_t victim;
+			if (w == Workload::ProducerConsumer)
+				victim = 0; // FIFO: oldest block first
+			else
+				victim = rng_next() % live.size();
+			allocator_free(live[victim]);
+			live.erase(live.begin() + static_cast<std::ptrdiff_t>(victim));
+		}
+		else
+		{
+			int id = allocator_malloc(next_size(w, op, total_ops), strategy);
+			if (id >= 0)
+				live.push_back(id);
+		}
+		auto t1 = clock::now();
+		latencies_ns.push_back(static_cast<std::uint32_t>(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count()));
+	}
+
+	auto t_end = clock::now();
+	double seconds = std::chrono::duration<double>(t_end - t_start).count();
+	double ops_per_sec = (seconds > 0.0) ? static_cast<double>(total_ops) / seconds : 0.0;
+
+	std::sort(latencies_ns.begin(), latencies_ns.end());
+	std::uint32_t p50 = latencies_ns[latencies_ns.size() / 2];
+	std::uint32_t p99 = latencies_ns[(latencies_ns.size() * 99) / 100];
+	std::uint32_t max = latencies_ns.back();
+
+	// Fragmentation from the live end-state, before cleanup.
+	AllocatorStatsSnapshot s = allocator_collect_stats();
+
+	std::cout << std::left << std::setw(18) << workload_name(w) << std::right
+			  << std::setw(12) << std::fixed << std::setprecision(0) << ops_per_sec << " ops/s"
+			  << std::setw(8) << p50 << " ns p50"
+			  << std::setw(8) << p99 << " ns p99"
+			  << std::setw(9) << max << " ns max"
+			  << std::setw(8) << std::setprecision(1) << s.internal_frag_pct << "% int"
+			  << std::setw(8) << s.external_frag_pct << "% ext"
+			  << std::setw(8) << s.utilization_pct << "% util"
+			  << "  fails=" << s.alloc_fail
+			  << "\n";
+	std::cout.unsetf(std::ios::fixed);
+}
+
+int main(int argc, char **argv)
+{
+	std::size_t total_ops = 1000000;
+	FitStrategy strategy = FitStrategy::First;
+
+	if (argc >= 2)
+		total_ops = static_cast<std::size_t>(std::stoull(argv[1]));
+	if (argc >= 3)
+		strategy = parse_strategy(argv[2]);
+
+	std::cout << "Allocator benchmark: " << total_ops << " ops per workload, heap "
+			  << BENCH_HEAP_SIZE << " bytes\n\n";
+
+	run_workload(Workload::Uniform, total_ops, strategy);
+	run_workload(Workload::Bimodal, total_ops, strategy);
+	run_workload(Workload::Ramp, total_ops, strategy);
+	run_workload(Workload::ProducerConsumer, total_ops, strategy);
+
+	return 0;
+}
@@ -1,4 +1,4 @@
-// Multi-level cache simulation usable from allocator.cpp and mainn.cpp.
+// Multi-level cache simulation; see include/cache.hpp for the API.
 //
 // Features:
 //   - Arbitrary number of cache levels (L1, L2, ...).
@@ -8,368 +8,1376 @@
 //   - Tracks hits/misses per level, hit ratios and average miss penalties
 //     (penalty propagation to lower levels and main memory).
 
+#include "cache.hpp"
+
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <vector>
 #include <iostream>
 #include <iomanip>
 #include <limits>
+#include <mutex>
 
-// ------------------------- Internal Types ------------------------- //
-
-struct CacheLine
-{
-	bool valid = false;
-	std::uintptr_t tag = 0;     // Tag of the cached block.
-	std::uint64_t freq = 0;     // LFU counter.
-	std::uint64_t last_used = 0; // For LRU tie-breaking.
-};
-
-struct CacheLevelStats
-{
-	std::uint64_t accesses = 0;
-	std::uint64_t hits = 0;
-	std::uint64_t misses = 0;
-	std::uint64_t miss_penalty_accum = 0; // Extra penalty due to going to lower levels.
-};
-
-class CacheLevel
-{
-public:
-	CacheLevel(std::size_t size_bytes,
-	           std::size_t block_size,
-	           std::size_t associativity,
-	           std::size_t access_latency_cycles,
-	           std::size_t level_index)
-	    : m_size_bytes(size_bytes),
-	      m_block_size(block_size ? block_size : 1),
-	      m_associativity(associativity ? associativity : 1),
-	      m_latency(access_latency_cycles ? access_latency_cycles : 1),
-	      m_level_index(level_index)
-	{
-		if (m_block_size == 0)
-			m_block_size = 1;
-
-		// Determine number of lines and sets.
-		std::size_t num_lines = m_size_bytes / m_block_size;
-		if (num_lines == 0)
-			num_lines = 1; // at least one line.
-
-		if (m_associativity == 0)
-			m_associativity = 1;
-		if (m_associativity > num_lines)
-			m_associativity = num_lines;
-
-		m_num_sets = num_lines / m_associativity;
-		if (m_num_sets == 0)
-		{
-			m_num_sets = 1;
-			m_associativity = num_lines; // fully-associative fallback.
-		}
+// Vectorized tag probes need 64-bit tags in the lanes; fall back to the
+// scalar loop on any other configuration.
+#if UINTPTR_MAX == 0xFFFFFFFFFFFFFFFFull && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#define CACHE_SIM_SIMD_TAGS 1
+#endif
+
+// ------------------------- Policy names --------------------------- //
+
+const char *prefetch_policy_name(PrefetchPolicy policy)
+{
+	switch (policy)
+	{
+	case PrefetchPolicy::None: return "none";
+	case PrefetchPolicy::NextLine: return "next-line";
+	case PrefetchPolicy::Stride: return "stride";
+	}
+	return "?";
+}
+
+const char *replacement_policy_name(ReplacementPolicy policy)
+{
+	switch (policy)
+	{
+	case ReplacementPolicy::LFU: return "LFU";
+	case ReplacementPolicy::LRU: return "LRU";
+	case ReplacementPolicy::FIFO: return "FIFO";
+	case ReplacementPolicy::Random: return "random";
+	case ReplacementPolicy::TreePLRU: return "tree-PLRU";
+	}
+	return "?";
+}
 
-		m_sets.resize(m_num_sets, std::vector<CacheLine>(m_associativity));
+const char *access_hint_name(AccessHint hint)
+{
+	switch (hint)
+	{
+	case AccessHint::Normal: return "normal";
+	case AccessHint::Streaming: return "streaming";
+	case AccessHint::Uncacheable: return "uncacheable";
 	}
+	return "?";
+}
 
-	std::size_t latency() const { return m_latency; }
-	std::size_t level_index() const { return m_level_index; }
+// -------------------------- CacheLevel ---------------------------- //
 
-	const CacheLevelStats &stats() const { return m_stats; }
-	CacheLevelStats &stats() { return m_stats; }
+CacheLevel::CacheLevel(std::size_t size_bytes,
+                       std::size_t block_size,
+                       std::size_t associativity,
+                       std::size_t access_latency_cycles,
+                       std::size_t level_index,
+                       ReplacementPolicy replacement)
+    : m_size_bytes(size_bytes),
+      m_block_size(block_size ? block_size : 1),
+      m_associativity(associativity ? associativity : 1),
+      m_latency(access_latency_cycles ? access_latency_cycles : 1),
+      m_level_index(level_index),
+      m_replacement(replacement)
+{
+	if (m_block_size == 0)
+		m_block_size = 1;
 
-	std::size_t size_bytes() const { return m_size_bytes; }
-	std::size_t block_size() const { return m_block_size; }
-	std::size_t associativity() const { return m_associativity; }
-	std::size_t num_sets() const { return m_num_sets; }
+	// Determine number of lines and sets.
+	std::size_t num_lines = m_size_bytes / m_block_size;
+	if (num_lines == 0)
+		num_lines = 1; // at least one line.
 
-	// Lookup an address. Returns true on hit and updates LFU/LRU data.
-	bool access(std::uintptr_t addr, std::uint64_t timestamp)
+	if (m_associativity == 0)
+		m_associativity = 1;
+	if (m_associativity > num_lines)
+		m_associativity = num_lines;
+
+	m_num_sets = num_lines / m_associativity;
+	if (m_num_sets == 0)
 	{
-		std::size_t set_idx;
-		std::uintptr_t tag;
-		compute_index_tag(addr, set_idx, tag);
+		m_num_sets = 1;
+		m_associativity = num_lines; // fully-associative fallback.
+	}
 
-		auto &set = m_sets[set_idx];
-		for (auto &line : set)
-		{
-			if (line.valid && line.tag == tag)
-			{
-				++line.freq;          // LFU count
-				line.last_used = timestamp; // LRU tie-break
-				return true;
-			}
-		}
+	std::size_t total_lines = m_num_sets * m_associativity;
+	m_valid.assign((total_lines + 63) / 64, 0);
+	m_dirty.assign((total_lines + 63) / 64, 0);
+	m_prefetched.assign((total_lines + 63) / 64, 0);
+	m_tags.assign(total_lines, TAG_NONE);
+	m_freq.assign(total_lines, 0);
+	m_last_used.assign(total_lines, 0);
+	m_inserted.assign(total_lines, 0);
+	m_fill_count.assign(m_num_sets, 0);
+	m_fifo_cursor.assign(m_num_sets, 0);
+
+	// Nearly every real geometry has a power-of-two block size and set
+	// count; precompute the shifts so the hot index/tag split avoids
+	// two integer divisions per probe.
+	if ((m_block_size & (m_block_size - 1)) == 0
+	    && (m_num_sets & (m_num_sets - 1)) == 0)
+	{
+		m_pow2_geometry = true;
+		for (std::size_t v = m_block_size; v > 1; v >>= 1)
+			++m_block_shift;
+		for (std::size_t v = m_num_sets; v > 1; v >>= 1)
+			++m_set_shift;
+	}
+
+	// PLRU needs a power-of-two fanout; otherwise degrade to true LRU.
+	if (m_replacement == ReplacementPolicy::TreePLRU
+	    && (m_associativity & (m_associativity - 1)) != 0)
+		m_replacement = ReplacementPolicy::LRU;
+	if (m_replacement == ReplacementPolicy::TreePLRU && m_associativity > 1)
+		m_plru_bits.resize(m_num_sets, std::vector<std::uint8_t>(m_associativity - 1, 0));
+}
+
+bool CacheLevel::save_state(std::FILE *fp) const
+{
+	if (std::fwrite(&m_stats, sizeof(m_stats), 1, fp) != 1)
+		return false;
+	if (std::fwrite(&m_rng_state, sizeof(m_rng_state), 1, fp) != 1)
+		return false;
+	if (std::fwrite(&m_stride_last_block, sizeof(m_stride_last_block), 1, fp) != 1
+	    || std::fwrite(&m_stride_last_delta, sizeof(m_stride_last_delta), 1, fp) != 1)
+		return false;
+	if (!write_array(fp, m_valid) || !write_array(fp, m_dirty)
+	    || !write_array(fp, m_prefetched) || !write_array(fp, m_tags)
+	    || !write_array(fp, m_freq) || !write_array(fp, m_last_used)
+	    || !write_array(fp, m_inserted) || !write_array(fp, m_fill_count)
+	    || !write_array(fp, m_fifo_cursor))
+		return false;
+	for (const auto &bits : m_plru_bits)
+		if (std::fwrite(bits.data(), 1, bits.size(), fp) != bits.size())
+			return false;
+	return true;
+}
+
+bool CacheLevel::load_state(std::FILE *fp)
+{
+	if (std::fread(&m_stats, sizeof(m_stats), 1, fp) != 1)
+		return false;
+	if (std::fread(&m_rng_state, sizeof(m_rng_state), 1, fp) != 1)
+		return false;
+	if (std::fread(&m_stride_last_block, sizeof(m_stride_last_block), 1, fp) != 1
+	    || std::fread(&m_stride_last_delta, sizeof(m_stride_last_delta), 1, fp) != 1)
 		return false;
+	if (!read_array(fp, m_valid) || !read_array(fp, m_dirty)
+	    || !read_array(fp, m_prefetched) || !read_array(fp, m_tags)
+	    || !read_array(fp, m_freq) || !read_array(fp, m_last_used)
+	    || !read_array(fp, m_inserted) || !read_array(fp, m_fill_count)
+	    || !read_array(fp, m_fifo_cursor))
+		return false;
+	for (auto &bits : m_plru_bits)
+		if (std::fread(bits.data(), 1, bits.size(), fp) != bits.size())
+			return false;
+	return true;
+}
+
+void CacheLevel::rebase(std::intptr_t delta)
+{
+	if (delta == 0)
+		return;
+
+	// Pull every resident line out, then re-file it under its moved
+	// address. compute_index_tag is inverted to recover the old block
+	// address from (tag, set); the byte offset within the block is not
+	// needed, the block-aligned address identifies the line.
+	struct SavedLine
+	{
+		std::uintptr_t tag;
+		std::size_t set;
+		std::uint64_t freq;
+		std::uint64_t last_used;
+		std::uint64_t inserted;
+		bool dirty;
+		bool prefetched;
+	};
+	std::vector<SavedLine> lines;
+	std::size_t total_lines = m_num_sets * m_associativity;
+	for (std::size_t i = 0; i < total_lines; ++i)
+	{
+		if (!bitmap_test(m_valid, i))
+			continue;
+		lines.push_back({m_tags[i], i / m_associativity, m_freq[i], m_last_used[i],
+		                 m_inserted[i], bitmap_test(m_dirty, i), bitmap_test(m_prefetched, i)});
 	}
 
-	// Insert (or update) a line corresponding to addr using LFU replacement.
-	void insert(std::uintptr_t addr, std::uint64_t timestamp)
+	m_valid.assign(m_valid.size(), 0);
+	m_dirty.assign(m_dirty.size(), 0);
+	m_prefetched.assign(m_prefetched.size(), 0);
+	m_tags.assign(total_lines, TAG_NONE);
+	m_freq.assign(total_lines, 0);
+	m_last_used.assign(total_lines, 0);
+	m_inserted.assign(total_lines, 0);
+	m_fill_count.assign(m_num_sets, 0);
+	m_fifo_cursor.assign(m_num_sets, 0);
+	for (auto &bits : m_plru_bits)
+		bits.assign(bits.size(), 0);
+
+	for (const SavedLine &line : lines)
 	{
+		std::uintptr_t block = line.tag * m_num_sets + line.set;
+		std::intptr_t addr = static_cast<std::intptr_t>(block * m_block_size) + delta;
+		if (addr < 0)
+			continue;
 		std::size_t set_idx;
 		std::uintptr_t tag;
-		compute_index_tag(addr, set_idx, tag);
+		compute_index_tag(static_cast<std::uintptr_t>(addr), set_idx, tag);
+		// A delta that is not a multiple of the set span can pile more
+		// lines into one set than it has ways; the overflow is dropped.
+		// (mmap deltas are page-aligned, so default geometries keep
+		// their sets and lose nothing.)
+		if (m_fill_count[set_idx] >= m_associativity)
+			continue;
+		std::size_t way = m_fill_count[set_idx]++;
+		std::size_t idx = set_idx * m_associativity + way;
+		bitmap_set(m_valid, idx, true);
+		bitmap_set(m_dirty, idx, line.dirty);
+		bitmap_set(m_prefetched, idx, line.prefetched);
+		m_tags[idx] = tag;
+		m_freq[idx] = line.freq;
+		m_last_used[idx] = line.last_used;
+		m_inserted[idx] = line.inserted;
+		plru_touch(set_idx, way);
+	}
 
-		auto &set = m_sets[set_idx];
+	// The stride prefetcher's anchor is a block number in the old
+	// mapping; shift it too (strides between blocks are unchanged).
+	if (m_stride_last_block != ~static_cast<std::uintptr_t>(0))
+	{
+		std::intptr_t anchor = static_cast<std::intptr_t>(m_stride_last_block)
+		                       + delta / static_cast<std::intptr_t>(m_block_size);
+		m_stride_last_block = (anchor >= 0) ? static_cast<std::uintptr_t>(anchor)
+		                                    : ~static_cast<std::uintptr_t>(0);
+	}
+}
 
-		// First try to find an invalid line.
-		for (auto &line : set)
-		{
-			if (!line.valid)
-			{
-				line.valid = true;
-				line.tag = tag;
-				line.freq = 1;
-				line.last_used = timestamp;
-				return;
-			}
-		}
+bool CacheLevel::access(std::uintptr_t addr, std::uint64_t timestamp, bool is_write)
+{
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
 
-		// No invalid line; choose victim via LFU with LRU tie-break.
-		std::size_t victim_idx = 0;
-		for (std::size_t i = 1; i < set.size(); ++i)
+	// The probe compares tags only: invalid lines hold TAG_NONE, so they
+	// cannot match a real tag, and the valid bit is consulted just to
+	// confirm a candidate (a genuine TAG_NONE tag is unreachable for
+	// any realistic address, but cheap to be exact about).
+	std::size_t base = set_idx * m_associativity;
+	std::size_t way = find_tag(base, tag);
+	if (way != m_associativity && bitmap_test(m_valid, base + way))
+	{
+		std::size_t line = base + way;
+		++m_freq[line];              // LFU count
+		m_last_used[line] = timestamp; // LRU (and LFU tie-break)
+		plru_touch(set_idx, way);
+		// No prefetch ever issued => no prefetched bit can be set;
+		// skip the bitmap probe on the (common) plain configuration.
+		if (m_stats.prefetch_issued != 0 && bitmap_test(m_prefetched, line))
 		{
-			const auto &curr = set[i];
-			const auto &vict = set[victim_idx];
-			if (curr.freq < vict.freq)
-			{
-				victim_idx = i;
-			}
-			else if (curr.freq == vict.freq && curr.last_used < vict.last_used)
-			{
-				victim_idx = i; // older => replace first
-			}
+			// First demand hit on a prefetched line: coverage win.
+			bitmap_set(m_prefetched, line, false);
+			m_stats.prefetch_useful += m_stat_scale;
 		}
-
-		CacheLine &victim = set[victim_idx];
-		victim.valid = true;
-		victim.tag = tag;
-		victim.freq = 1;
-		victim.last_used = timestamp;
+		if (is_write && m_write_policy == WritePolicy::WriteBack)
+			bitmap_set(m_dirty, line, true);
+		return true;
 	}
+	return false;
+}
 
-private:
-	void compute_index_tag(std::uintptr_t addr, std::size_t &set_idx, std::uintptr_t &tag) const
-	{
-		std::uintptr_t block_addr = addr / m_block_size;
-		set_idx = static_cast<std::size_t>(block_addr % m_num_sets);
-		tag = block_addr / m_num_sets;
-	}
+void CacheLevel::insert(std::uintptr_t addr, std::uint64_t timestamp, bool is_write, bool &evicted_dirty)
+{
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
 
-private:
-	std::size_t m_size_bytes;
-	std::size_t m_block_size;
-	std::size_t m_associativity;
-	std::size_t m_latency;      // cycles per access at this level
-	std::size_t m_num_sets;
-	std::size_t m_level_index;  // 0 for L1, 1 for L2, ...
+	evicted_dirty = false;
+	bool fill_dirty = is_write && m_write_policy == WritePolicy::WriteBack;
 
-	std::vector<std::vector<CacheLine>> m_sets;
-	CacheLevelStats m_stats;
-};
+	fill_line(set_idx, tag, timestamp, fill_dirty, false, evicted_dirty);
+}
 
-// ---------------------- Multi-level controller -------------------- //
+int CacheLevel::residency(std::uintptr_t addr) const
+{
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
+	std::size_t base = set_idx * m_associativity;
+	std::size_t way = find_tag(base, tag);
+	if (way == m_associativity || !bitmap_test(m_valid, base + way))
+		return -1;
+	return bitmap_test(m_dirty, base + way) ? 1 : 0;
+}
+
+int CacheLevel::invalidate(std::uintptr_t addr)
+{
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
+	std::size_t base = set_idx * m_associativity;
+	std::size_t way = find_tag(base, tag);
+	if (way == m_associativity || !bitmap_test(m_valid, base + way))
+		return -1;
+	std::size_t line = base + way;
+	int was_dirty = bitmap_test(m_dirty, line) ? 1 : 0;
+	bitmap_set(m_valid, line, false);
+	bitmap_set(m_dirty, line, false);
+	bitmap_set(m_prefetched, line, false);
+	m_tags[line] = TAG_NONE;
+	m_freq[line] = 0;
+	m_last_used[line] = 0;
+	m_inserted[line] = 0;
+	return was_dirty;
+}
+
+void CacheLevel::downgrade(std::uintptr_t addr)
+{
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
+	std::size_t base = set_idx * m_associativity;
+	std::size_t way = find_tag(base, tag);
+	if (way != m_associativity && bitmap_test(m_valid, base + way))
+		bitmap_set(m_dirty, base + way, false);
+}
 
-class MultiLevelCache
+void CacheLevel::prefetch(std::uintptr_t addr, std::uint64_t timestamp)
 {
-public:
-	MultiLevelCache() = default;
+	std::size_t set_idx;
+	std::uintptr_t tag;
+	compute_index_tag(addr, set_idx, tag);
 
-	void reset()
+	std::size_t base = set_idx * m_associativity;
+	std::size_t way = find_tag(base, tag);
+	if (way != m_associativity && bitmap_test(m_valid, base + way))
+		return; // already resident
+
+	bool evicted_dirty = false;
+	fill_line(set_idx, tag, timestamp, false, true, evicted_dirty);
+	if (evicted_dirty)
+		m_stats.writebacks += m_stat_scale;
+	m_stats.prefetch_issued += m_stat_scale;
+}
+
+void CacheLevel::prefetch_after_miss(std::uintptr_t addr, std::uint64_t timestamp)
+{
+	if (m_prefetch == PrefetchPolicy::None)
+		return;
+
+	std::uintptr_t block = addr / m_block_size;
+	std::intptr_t stride = 1;
+	if (m_prefetch == PrefetchPolicy::Stride)
 	{
-		m_levels.clear();
-		m_memory_latency = 100; // default main memory penalty (cycles)
-		m_timestamp = 0;
-		m_total_accesses = 0;
-		m_total_hits = 0;
-		m_total_misses = 0;
-		m_total_penalty = 0;
+		bool confirmed = false;
+		if (m_stride_last_block != ~static_cast<std::uintptr_t>(0))
+		{
+			std::intptr_t delta = static_cast<std::intptr_t>(block)
+			                      - static_cast<std::intptr_t>(m_stride_last_block);
+			confirmed = (delta != 0 && delta == m_stride_last_delta);
+			m_stride_last_delta = delta;
+		}
+		m_stride_last_block = block;
+		if (!confirmed)
+			return; // stride not established yet
+		stride = m_stride_last_delta;
 	}
 
-	void set_memory_latency(std::size_t latency_cycles)
+	for (std::size_t k = 1; k <= m_prefetch_degree; ++k)
 	{
-		m_memory_latency = latency_cycles ? latency_cycles : 1;
+		std::intptr_t target = static_cast<std::intptr_t>(block) + stride * static_cast<std::intptr_t>(k);
+		if (target < 0)
+			break;
+		prefetch(static_cast<std::uintptr_t>(target) * m_block_size, timestamp);
 	}
+}
 
-	// Append a new cache level (L1 is index 0, L2 is 1, ...).
-	void add_level(std::size_t size_bytes,
-	              std::size_t block_size,
-	              std::size_t associativity,
-	              std::size_t access_latency_cycles)
+void CacheLevel::set_prefetcher(PrefetchPolicy policy, std::size_t degree)
+{
+	m_prefetch = policy;
+	m_prefetch_degree = degree ? degree : 1;
+	m_stride_last_block = ~static_cast<std::uintptr_t>(0);
+	m_stride_last_delta = 0;
+}
+
+void CacheLevel::compute_index_tag(std::uintptr_t addr, std::size_t &set_idx, std::uintptr_t &tag) const
+{
+	if (m_pow2_geometry)
 	{
-		std::size_t level_index = m_levels.size();
-		m_levels.emplace_back(size_bytes, block_size, associativity, access_latency_cycles, level_index);
+		std::uintptr_t block_addr = addr >> m_block_shift;
+		set_idx = static_cast<std::size_t>(block_addr & (m_num_sets - 1));
+		tag = block_addr >> m_set_shift;
+		return;
 	}
+	std::uintptr_t block_addr = addr / m_block_size;
+	set_idx = static_cast<std::size_t>(block_addr % m_num_sets);
+	tag = block_addr / m_num_sets;
+}
 
-	std::size_t level_count() const
+// Find the way within the set whose tag matches, or m_associativity if
+// none does. The per-set tag run is contiguous, so the probe compares
+// 4 (AVX2) or 2 (SSE2) tags per step; the trailing loop handles the
+// remainder and doubles as the scalar fallback.
+std::size_t CacheLevel::find_tag(std::size_t base, std::uintptr_t tag) const
+{
+	std::size_t way = 0;
+#if defined(CACHE_SIM_SIMD_TAGS) && defined(__AVX2__)
+	__m256i needle = _mm256_set1_epi64x(static_cast<long long>(tag));
+	for (; way + 4 <= m_associativity; way += 4)
 	{
-		return m_levels.size();
+		__m256i tags = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&m_tags[base + way]));
+		int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(tags, needle)));
+		if (mask)
+			return way + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
 	}
-
-	void configure_level(std::size_t level_index,
-	                     std::size_t size_bytes,
-	                     std::size_t block_size,
-	                     std::size_t associativity,
-	                     std::size_t access_latency_cycles)
+#elif defined(CACHE_SIM_SIMD_TAGS)
+	__m128i needle = _mm_set1_epi64x(static_cast<long long>(tag));
+	for (; way + 2 <= m_associativity; way += 2)
 	{
-		if (level_index >= m_levels.size())
-			return;
-		m_levels[level_index] = CacheLevel(size_bytes, block_size, associativity, access_latency_cycles, level_index);
+		__m128i tags = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&m_tags[base + way]));
+		// SSE2 has no 64-bit compare: both 32-bit halves of a lane
+		// must match its swapped pair for the lane to be equal.
+		__m128i eq32 = _mm_cmpeq_epi32(tags, needle);
+		__m128i eq64 = _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+		int mask = _mm_movemask_pd(_mm_castsi128_pd(eq64));
+		if (mask)
+			return way + ((mask & 1) ? 0u : 1u);
 	}
+#endif
+	for (; way < m_associativity; ++way)
+		if (m_tags[base + way] == tag)
+			return way;
+	return m_associativity;
+}
 
-	// Perform a read/write access and update statistics.
-	// The access is address-based; allocator/main can choose any
-	// scheme for mapping its ids/offsets to an address.
-	void access(std::uintptr_t addr, bool /*is_write*/)
-	{
-		if (m_levels.empty())
-			return;
+// Place a tag into a set: the next never-used way if one exists, else
+// the replacement policy's victim. Shared by demand fills and
+// prefetches.
+void CacheLevel::fill_line(std::size_t set_idx, std::uintptr_t tag, std::uint64_t timestamp,
+                           bool fill_dirty, bool prefetched, bool &evicted_dirty)
+{
+	std::size_t base = set_idx * m_associativity;
 
-		++m_timestamp;
-		++m_total_accesses;
+	// Lines become valid on fill and only coherence invalidation drops
+	// them, so a per-set fill count hands out the next never-used way
+	// without scanning. A hole an invalidation leaves in a filled set
+	// is reclaimed through victim selection instead: the invalidated
+	// way's zeroed metadata makes it an early pick for every policy.
+	std::size_t way;
+	if (m_fill_count[set_idx] < m_associativity)
+	{
+		way = m_fill_count[set_idx]++;
+	}
+	else
+	{
+		way = select_victim(set_idx);
+		evicted_dirty = bitmap_test(m_dirty, base + way);
+	}
 
-		std::size_t total_penalty = 0;
-		bool hit_any = false;
-		int level_hit = -1;
+	std::size_t line = base + way;
+	bitmap_set(m_valid, line, true);
+	bitmap_set(m_dirty, line, fill_dirty);
+	bitmap_set(m_prefetched, line, prefetched);
+	m_tags[line] = tag;
+	m_freq[line] = 1;
+	m_last_used[line] = timestamp;
+	m_inserted[line] = timestamp;
+	plru_touch(set_idx, way);
+}
 
-		struct MissRecord
+// Point the PLRU tree away from the way that was just touched. The tree
+// is a heap-ordered array of m_associativity-1 bits; bit 0 means the
+// victim path continues left, 1 means right.
+void CacheLevel::plru_touch(std::size_t set_idx, std::size_t way)
+{
+	if (m_plru_bits.empty())
+		return;
+	auto &bits = m_plru_bits[set_idx];
+	std::size_t node = 0;
+	std::size_t lo = 0, hi = m_associativity;
+	while (hi - lo > 1)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+		if (way < mid)
 		{
-			int level;
-			std::size_t penalty_upto_level; // including this level's latency
-		};
-		std::vector<MissRecord> miss_records;
-
-		// Walk through each cache level.
-		for (std::size_t i = 0; i < m_levels.size(); ++i)
+			bits[node] = 1; // accessed left => victim path goes right
+			node = 2 * node + 1;
+			hi = mid;
+		}
+		else
 		{
-			CacheLevel &lvl = m_levels[i];
-			CacheLevelStats &st = lvl.stats();
+			bits[node] = 0; // accessed right => victim path goes left
+			node = 2 * node + 2;
+			lo = mid;
+		}
+	}
+}
 
-			total_penalty += lvl.latency();
-			++st.accesses;
+// Follow the PLRU bits from the root to the victim way.
+std::size_t CacheLevel::plru_victim(std::size_t set_idx) const
+{
+	const auto &bits = m_plru_bits[set_idx];
+	std::size_t node = 0;
+	std::size_t lo = 0, hi = m_associativity;
+	while (hi - lo > 1)
+	{
+		std::size_t mid = lo + (hi - lo) / 2;
+		if (bits[node] == 0)
+		{
+			node = 2 * node + 1;
+			hi = mid;
+		}
+		else
+		{
+			node = 2 * node + 2;
+			lo = mid;
+		}
+	}
+	return lo;
+}
 
-			if (lvl.access(addr, m_timestamp))
+std::size_t CacheLevel::select_victim(std::size_t set_idx)
+{
+	std::size_t base = set_idx * m_associativity;
+	switch (m_replacement)
+	{
+	case ReplacementPolicy::LFU:
+	{
+		// LFU with LRU tie-break (the historical default).
+		std::size_t victim = 0;
+		for (std::size_t i = 1; i < m_associativity; ++i)
+		{
+			if (m_freq[base + i] < m_freq[base + victim])
 			{
-				++st.hits;
-				hit_any = true;
-				level_hit = static_cast<int>(i);
-				break;
+				victim = i;
 			}
-			else
+			else if (m_freq[base + i] == m_freq[base + victim]
+			         && m_last_used[base + i] < m_last_used[base + victim])
 			{
-				++st.misses;
-				miss_records.push_back({static_cast<int>(i), total_penalty});
+				victim = i; // older => replace first
 			}
 		}
+		return victim;
+	}
+	case ReplacementPolicy::LRU:
+	{
+		std::size_t victim = 0;
+		for (std::size_t i = 1; i < m_associativity; ++i)
+			if (m_last_used[base + i] < m_last_used[base + victim])
+				victim = i;
+		return victim;
+	}
+	case ReplacementPolicy::FIFO:
+	{
+		// Ways fill and then evict in cyclic order, so a per-set
+		// cursor is equivalent to scanning for the oldest insertion.
+		std::size_t victim = m_fifo_cursor[set_idx];
+		m_fifo_cursor[set_idx] = static_cast<std::uint16_t>((victim + 1) % m_associativity);
+		return victim;
+	}
+	case ReplacementPolicy::Random:
+	{
+		// xorshift64; deterministic per level, so runs are reproducible.
+		std::uint64_t x = m_rng_state;
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		m_rng_state = x;
+		return static_cast<std::size_t>(x % m_associativity);
+	}
+	case ReplacementPolicy::TreePLRU:
+		return plru_victim(set_idx);
+	}
+	return 0;
+}
+
+// ---------------------- Multi-level controller -------------------- //
+
+void MultiLevelCache::reset()
+{
+	// The sampling scale belongs to whoever feeds accesses (the
+	// allocator's sampled cachesim mode), not to the hierarchy being
+	// rebuilt: rebuilding levels through reset() must not silently
+	// start under-reporting every counter by the sampling factor.
+	// add_level() and configure_tlb() re-apply it to new levels.
+	m_levels.clear();
+	m_memory_latency = 100; // default main memory penalty (cycles)
+	m_timestamp = 0;
+	m_total_accesses = 0;
+	m_total_hits = 0;
+	m_total_misses = 0;
+	m_total_penalty = 0;
+	m_tlb.clear();
+	m_tlb_enabled = false;
+	m_tlb_stats = TlbStats();
+	m_num_cores = 1;
+	m_private.clear();
+	m_coherence = CoherenceStats();
+	m_streaming_accesses = 0;
+	m_uncacheable_accesses = 0;
+}
+
+void MultiLevelCache::set_sample_scale(std::size_t scale)
+{
+	m_sample_scale = scale ? scale : 1;
+	for (CacheLevel &lvl : m_levels)
+		lvl.set_stat_scale(m_sample_scale);
+	for (std::vector<CacheLevel> &core_levels : m_private)
+		for (CacheLevel &lvl : core_levels)
+			lvl.set_stat_scale(m_sample_scale);
+	if (m_tlb_enabled)
+		m_tlb[0].set_stat_scale(m_sample_scale);
+}
+
+void MultiLevelCache::add_level(std::size_t size_bytes,
+                                std::size_t block_size,
+                                std::size_t associativity,
+                                std::size_t access_latency_cycles,
+                                ReplacementPolicy replacement)
+{
+	std::size_t level_index = m_levels.size();
+	m_levels.emplace_back(size_bytes, block_size, associativity, access_latency_cycles, level_index, replacement);
+	m_levels.back().set_stat_scale(m_sample_scale);
+	rebuild_private();
+}
+
+void MultiLevelCache::set_cores(std::size_t cores)
+{
+	if (cores < 1)
+		cores = 1;
+	if (cores > 64)
+		cores = 64;
+	m_num_cores = cores;
+	rebuild_private();
+}
+
+void MultiLevelCache::configure_tlb(std::size_t entries, std::size_t page_size,
+                                    std::size_t associativity, std::size_t walk_penalty_cycles)
+{
+	m_tlb.clear();
+	m_tlb_stats = TlbStats();
+	if (entries == 0)
+	{
+		m_tlb_enabled = false;
+		return;
+	}
+	if (page_size == 0)
+		page_size = 4096;
+	m_tlb_entries = entries;
+	m_tlb_page_size = page_size;
+	m_tlb_assoc = associativity ? associativity : entries;
+	m_page_walk_penalty = walk_penalty_cycles ? walk_penalty_cycles : 1;
+	m_tlb.emplace_back(entries * page_size, page_size, m_tlb_assoc, 1, 0,
+	                   ReplacementPolicy::LRU);
+	m_tlb[0].set_stat_scale(m_sample_scale);
+	m_tlb_enabled = true;
+}
+
+void MultiLevelCache::set_huge_pages(bool enabled)
+{
+	if (!m_tlb_enabled)
+		return;
+	configure_tlb(m_tlb_entries, enabled ? 2 * 1024 * 1024 : 4096,
+	              m_tlb_assoc, m_page_walk_penalty);
+}
+
+void MultiLevelCache::configure_level(std::size_t level_index,
+                                      std::size_t size_bytes,
+                                      std::size_t block_size,
+                                      std::size_t associativity,
+                                      std::size_t access_latency_cycles)
+{
+	if (level_index >= m_levels.size())
+		return;
+	configure_level(level_index, size_bytes, block_size, associativity,
+	                access_latency_cycles, m_levels[level_index].replacement_policy());
+}
+
+void MultiLevelCache::configure_level(std::size_t level_index,
+                                      std::size_t size_bytes,
+                                      std::size_t block_size,
+                                      std::size_t associativity,
+                                      std::size_t access_latency_cycles,
+                                      ReplacementPolicy replacement)
+{
+	if (level_index >= m_levels.size())
+		return;
+	// Resizing a level keeps its write policies.
+	WritePolicy write_policy = m_levels[level_index].write_policy();
+	AllocatePolicy allocate_policy = m_levels[level_index].allocate_policy();
+	m_levels[level_index] = CacheLevel(size_bytes, block_size, associativity, access_latency_cycles, level_index, replacement);
+	m_levels[level_index].set_write_policy(write_policy);
+	m_levels[level_index].set_allocate_policy(allocate_policy);
+	m_levels[level_index].set_stat_scale(m_sample_scale);
+	rebuild_private();
+}
+
+void MultiLevelCache::set_write_policy(std::size_t level_index, WritePolicy write_policy,
+                                       AllocatePolicy allocate_policy)
+{
+	if (level_index >= m_levels.size())
+		return;
+	m_levels[level_index].set_write_policy(write_policy);
+	m_levels[level_index].set_allocate_policy(allocate_policy);
+	rebuild_private();
+}
+
+void MultiLevelCache::set_prefetcher(std::size_t level_index, PrefetchPolicy policy, std::size_t degree)
+{
+	if (level_index >= m_levels.size())
+		return;
+	m_levels[level_index].set_prefetcher(policy, degree);
+	rebuild_private();
+}
+
+void MultiLevelCache::access(std::uintptr_t addr, bool is_write, std::size_t core,
+                             AccessHint hint)
+{
+	if (m_levels.empty())
+		return;
+
+	++m_timestamp;
+	m_total_accesses += m_sample_scale;
 
-		// If no cache level hit, go to main memory.
-		if (!hit_any)
+	std::size_t total_penalty = 0;
+
+	// Translation comes first: a TLB miss stalls the whole access for
+	// the page walk before any cache level can respond. (One shared
+	// translation stage even in topology mode — per-core TLBs are not
+	// modeled.)
+	if (m_tlb_enabled)
+	{
+		m_tlb_stats.accesses += m_sample_scale;
+		if (m_tlb[0].access(addr, m_timestamp, false))
 		{
-			total_penalty += m_memory_latency;
-			level_hit = static_cast<int>(m_levels.size()); // "memory" index
-			++m_total_misses;
+			m_tlb_stats.hits += m_sample_scale;
 		}
 		else
 		{
-			++m_total_hits;
+			m_tlb_stats.misses += m_sample_scale;
+			m_tlb_stats.walk_cycles += m_page_walk_penalty * m_sample_scale;
+			total_penalty += m_page_walk_penalty;
+			bool evicted_dirty = false;
+			m_tlb[0].insert(addr, m_timestamp, false, evicted_dirty);
 		}
+	}
+
+	// Uncacheable accesses skip the hierarchy entirely: translation
+	// still happens above, then memory is charged and no line moves.
+	if (hint == AccessHint::Uncacheable)
+	{
+		m_uncacheable_accesses += m_sample_scale;
+		m_total_misses += m_sample_scale;
+		total_penalty += m_memory_latency;
+		m_total_penalty += total_penalty * m_sample_scale;
+		return;
+	}
+	if (hint == AccessHint::Streaming)
+		m_streaming_accesses += m_sample_scale;
 
-		// Propagate line into all levels up to and including the level
-		// where the hit/memory access occurred (inclusive cache model).
-		int fill_upto = level_hit;
-		if (fill_upto == static_cast<int>(m_levels.size()))
+	// Resolve the level stack this access walks: the flat hierarchy,
+	// or the issuing core's private levels over the shared last level.
+	CacheLevel *stack[MAX_WALK_LEVELS];
+	std::size_t depth = 0;
+	bool peer_holds = false; // some other core's private cache has the line
+	bool peer_dirty = false; // ...and that copy is modified
+	if (m_private.empty())
+	{
+		for (std::size_t i = 0; i < m_levels.size() && depth < MAX_WALK_LEVELS; ++i)
+			stack[depth++] = &m_levels[i];
+	}
+	else
+	{
+		core %= m_num_cores;
+		for (CacheLevel &lvl : m_private[core])
 		{
-			// Miss in all levels, fetched from memory; fill all levels.
-			fill_upto = static_cast<int>(m_levels.size()) - 1;
+			if (depth + 1 < MAX_WALK_LEVELS)
+				stack[depth++] = &lvl;
 		}
-		for (int i = 0; i <= fill_upto && i >= 0; ++i)
+		stack[depth++] = &m_levels.back();
+
+		// Probe the peers before touching anything (the write
+		// invalidation below would erase the evidence): a copy in any
+		// peer makes a private miss a coherence miss, and a dirty copy
+		// forces the owner to flush before this core can have the line.
+		for (std::size_t c = 0; c < m_num_cores; ++c)
 		{
-			m_levels[static_cast<std::size_t>(i)].insert(addr, m_timestamp);
+			if (c == core)
+				continue;
+			for (CacheLevel &lvl : m_private[c])
+			{
+				int residency = lvl.residency(addr);
+				if (residency < 0)
+					continue;
+				peer_holds = true;
+				if (residency == 1)
+					peer_dirty = true;
+				if (is_write)
+				{
+					// MESI-style invalidation: the writer gains
+					// exclusive ownership, so every peer copy is
+					// dropped; dirty copies flush to the shared level.
+					lvl.invalidate(addr);
+					m_coherence.invalidations += m_sample_scale;
+					if (residency == 1)
+					{
+						m_coherence.inval_writebacks += m_sample_scale;
+						total_penalty += m_levels.back().latency();
+					}
+				}
+				else if (residency == 1)
+				{
+					// Remote read of a modified line: the owner writes
+					// it back and keeps a shared (clean) copy.
+					lvl.downgrade(addr);
+					total_penalty += m_levels.back().latency();
+				}
+			}
 		}
+	}
+
+	bool hit_any = false;
+	int level_hit = -1;
+	std::size_t missed_levels = 0; // levels 0..missed_levels-1 all missed
+
+	// Walk through each cache level of the stack.
+	for (std::size_t i = 0; i < depth; ++i)
+	{
+		CacheLevel &lvl = *stack[i];
+		CacheLevelStats &st = lvl.stats();
 
-		// Attribute miss penalty propagation to each level that missed.
-		for (const auto &rec : miss_records)
+		total_penalty += lvl.latency();
+		st.accesses += m_sample_scale;
+
+		if (lvl.access(addr, m_timestamp, is_write))
 		{
-			if (rec.level >= 0 && static_cast<std::size_t>(rec.level) < m_levels.size())
+			st.hits += m_sample_scale;
+			// A write-through hit pays to push the write one level
+			// down (or to memory) immediately.
+			if (is_write && lvl.write_policy() == WritePolicy::WriteThrough)
 			{
-				std::size_t extra_penalty = 0;
-				if (total_penalty > rec.penalty_upto_level)
-					extra_penalty = total_penalty - rec.penalty_upto_level;
-				m_levels[static_cast<std::size_t>(rec.level)].stats().miss_penalty_accum += extra_penalty;
+				total_penalty += stack_downstream(stack, depth, i);
+				st.write_throughs += m_sample_scale;
 			}
+			hit_any = true;
+			level_hit = static_cast<int>(i);
+			break;
 		}
+		else
+		{
+			st.misses += m_sample_scale;
+			++missed_levels;
+		}
+	}
 
-		m_total_penalty += total_penalty;
+	// If no cache level hit, the data comes from a peer's private cache
+	// (cache-to-cache transfer at shared-level cost) or main memory.
+	if (!hit_any)
+	{
+		level_hit = static_cast<int>(depth); // "memory" index
+		if (peer_holds)
+		{
+			total_penalty += m_levels.back().latency();
+			m_total_hits += m_sample_scale;
+		}
+		else
+		{
+			total_penalty += m_memory_latency;
+			m_total_misses += m_sample_scale;
+		}
+	}
+	else
+	{
+		m_total_hits += m_sample_scale;
 	}
 
-	void dump_stats(std::ostream &os) const
+	// A miss in every private level whose line lives in a peer's
+	// private cache is a coherence miss: without the sharing (or the
+	// earlier invalidation) the line could still have been local.
+	if (peer_holds && level_hit >= static_cast<int>(depth) - 1)
 	{
-		os << "Multi-level cache statistics:\n";
-		os << "  Levels: " << m_levels.size() << "\n";
-		os << "  Main memory latency: " << m_memory_latency << " cycles\n";
-		os << "  Total accesses: " << m_total_accesses << "\n";
-		os << "  Total hits:     " << m_total_hits << "\n";
-		os << "  Total misses:   " << m_total_misses << "\n";
-		double global_hit_ratio = 0.0;
-		if (m_total_accesses)
-			global_hit_ratio = 100.0 * static_cast<double>(m_total_hits) / static_cast<double>(m_total_accesses);
-		os << "  Global hit ratio: " << std::fixed << std::setprecision(2)
-		   << global_hit_ratio << "%\n";
-		double avg_penalty = 0.0;
-		if (m_total_accesses)
-			avg_penalty = static_cast<double>(m_total_penalty) / static_cast<double>(m_total_accesses);
-		os << "  Avg access penalty: " << avg_penalty << " cycles/access\n";
+		m_coherence.coherence_misses += m_sample_scale;
+		if (peer_dirty)
+			m_coherence.dirty_transfers += m_sample_scale;
+	}
 
-		os << "\nPer-level details:\n";
-		for (std::size_t i = 0; i < m_levels.size(); ++i)
+	// Propagate line into all levels up to and including the level
+	// where the hit/memory access occurred (inclusive cache model).
+	int fill_upto = level_hit;
+	if (fill_upto == static_cast<int>(depth))
+	{
+		// Miss in all levels, fetched from memory; fill all levels.
+		fill_upto = static_cast<int>(depth) - 1;
+	}
+	// Non-temporal accesses never allocate: a hit used the line where
+	// it already was, a miss went straight through without displacing
+	// anything (and without training the prefetchers).
+	if (hint == AccessHint::Streaming)
+		fill_upto = -1;
+	for (int i = 0; i <= fill_upto && i >= 0; ++i)
+	{
+		CacheLevel &lvl = *stack[static_cast<std::size_t>(i)];
+		// No-write-allocate levels let write misses bypass them.
+		if (is_write && lvl.allocate_policy() == AllocatePolicy::NoWriteAllocate
+		    && i != level_hit)
+			continue;
+		bool evicted_dirty = false;
+		lvl.insert(addr, m_timestamp, is_write, evicted_dirty);
+		if (evicted_dirty)
 		{
-			const CacheLevel &lvl = m_levels[i];
-			const CacheLevelStats &st = lvl.stats();
-			os << "  L" << (i + 1) << ": size=" << lvl.size_bytes()
-			   << " bytes, block=" << lvl.block_size()
-			   << " bytes, assoc=" << lvl.associativity()
-			   << "-way, sets=" << lvl.num_sets()
-			   << ", latency=" << lvl.latency() << " cycles\n";
-			os << "     accesses=" << st.accesses
-			   << ", hits=" << st.hits
-			   << ", misses=" << st.misses;
-			double hit_ratio = 0.0;
-			if (st.accesses)
-				hit_ratio = 100.0 * static_cast<double>(st.hits) / static_cast<double>(st.accesses);
-			os << ", hit ratio=" << std::fixed << std::setprecision(2)
-			   << hit_ratio << "%";
-			double avg_miss_penalty = 0.0;
-			if (st.misses)
-				avg_miss_penalty = static_cast<double>(st.miss_penalty_accum) / static_cast<double>(st.misses);
-			os << ", avg miss penalty to lower levels=" << avg_miss_penalty << " cycles\n";
+			// Evicting a dirty line costs a write to the next level
+			// down (or memory), charged to the evicting level.
+			std::size_t writeback_cost = stack_downstream(stack, depth, static_cast<std::size_t>(i));
+			total_penalty += writeback_cost;
+			lvl.stats().miss_penalty_accum += writeback_cost * m_sample_scale;
+			lvl.stats().writebacks += m_sample_scale;
 		}
 	}
 
-private:
-	std::vector<CacheLevel> m_levels;
-	std::size_t m_memory_latency = 100; // cycles to access main memory
-	std::uint64_t m_timestamp = 0;      // global logical time for LRU tie-breaks
+	// Let each level that missed feed its prefetcher; prefetch fills
+	// happen off the critical path and charge no latency here.
+	if (hint != AccessHint::Streaming)
+		for (std::size_t i = 0; i < missed_levels; ++i)
+			stack[i]->prefetch_after_miss(addr, m_timestamp);
+
+	// Attribute miss penalty propagation to each level that missed.
+	// The missed levels are exactly the first `missed_levels` levels of
+	// the walk, so the penalty accumulated up to each one can be rebuilt
+	// incrementally — no per-access record storage needed.
+	std::size_t penalty_upto_level = 0;
+	for (std::size_t i = 0; i < missed_levels; ++i)
+	{
+		penalty_upto_level += stack[i]->latency();
+		std::size_t extra_penalty = 0;
+		if (total_penalty > penalty_upto_level)
+			extra_penalty = total_penalty - penalty_upto_level;
+		stack[i]->stats().miss_penalty_accum += extra_penalty * m_sample_scale;
+	}
+
+	m_total_penalty += total_penalty * m_sample_scale;
+}
+
+void MultiLevelCache::access_range(std::uintptr_t addr, std::size_t len, bool is_write, std::size_t core,
+                                   AccessHint hint)
+{
+	if (m_levels.empty() || len == 0)
+		return;
+
+	std::size_t granularity = m_levels[0].block_size();
+	for (std::size_t i = 1; i < m_levels.size(); ++i)
+	{
+		if (m_levels[i].block_size() < granularity)
+			granularity = m_levels[i].block_size();
+	}
+
+	std::uintptr_t first_block = addr / granularity;
+	std::uintptr_t last_block = (addr + len - 1) / granularity;
+	for (std::uintptr_t block = first_block; block <= last_block; ++block)
+		access(block * granularity, is_write, core, hint);
+}
+
+bool MultiLevelCache::save(std::FILE *fp) const
+{
+	std::uint64_t header[6] = {
+		m_memory_latency, m_timestamp,
+		m_total_accesses, m_total_hits, m_total_misses, m_total_penalty};
+	if (std::fwrite(header, sizeof(header), 1, fp) != 1)
+		return false;
+
+	std::uint64_t level_count = m_levels.size();
+	if (std::fwrite(&level_count, sizeof(level_count), 1, fp) != 1)
+		return false;
+
+	for (const CacheLevel &lvl : m_levels)
+	{
+		std::uint64_t geom[4] = {lvl.size_bytes(), lvl.block_size(),
+		                         lvl.associativity(), lvl.latency()};
+		std::uint8_t policies[5] = {
+			static_cast<std::uint8_t>(lvl.write_policy()),
+			static_cast<std::uint8_t>(lvl.allocate_policy()),
+			static_cast<std::uint8_t>(lvl.replacement_policy()),
+			static_cast<std::uint8_t>(lvl.prefetch_policy()),
+			static_cast<std::uint8_t>(lvl.prefetch_degree())};
+		if (std::fwrite(geom, sizeof(geom), 1, fp) != 1)
+			return false;
+		if (std::fwrite(policies, sizeof(policies), 1, fp) != 1)
+			return false;
+		if (!lvl.save_state(fp))
+			return false;
+	}
+
+	std::uint64_t tlb_config[5] = {
+		m_tlb_enabled ? 1ull : 0ull, m_tlb_entries, m_tlb_page_size,
+		m_tlb_assoc, m_page_walk_penalty};
+	if (std::fwrite(tlb_config, sizeof(tlb_config), 1, fp) != 1)
+		return false;
+	if (std::fwrite(&m_tlb_stats, sizeof(m_tlb_stats), 1, fp) != 1)
+		return false;
+	if (m_tlb_enabled && !m_tlb[0].save_state(fp))
+		return false;
+
+	// Topology section: core count, coherence counters, then every
+	// private level's state (geometry is re-derived from the shared
+	// level configs on load, so only contents need serializing).
+	std::uint64_t cores = m_num_cores;
+	if (std::fwrite(&cores, sizeof(cores), 1, fp) != 1)
+		return false;
+	if (std::fwrite(&m_coherence, sizeof(m_coherence), 1, fp) != 1)
+		return false;
+	std::uint64_t hint_counters[2] = {m_streaming_accesses, m_uncacheable_accesses};
+	if (std::fwrite(hint_counters, sizeof(hint_counters), 1, fp) != 1)
+		return false;
+	for (const std::vector<CacheLevel> &core_levels : m_private)
+		for (const CacheLevel &lvl : core_levels)
+			if (!lvl.save_state(fp))
+				return false;
+	return true;
+}
+
+bool MultiLevelCache::load(std::FILE *fp)
+{
+	reset();
+
+	std::uint64_t header[6];
+	if (std::fread(header, sizeof(header), 1, fp) != 1)
+		return false;
+	m_memory_latency = static_cast<std::size_t>(header[0]);
+	m_timestamp = header[1];
+	m_total_accesses = header[2];
+	m_total_hits = header[3];
+	m_total_misses = header[4];
+	m_total_penalty = header[5];
+
+	std::uint64_t level_count = 0;
+	if (std::fread(&level_count, sizeof(level_count), 1, fp) != 1)
+		return false;
+
+	for (std::uint64_t i = 0; i < level_count; ++i)
+	{
+		std::uint64_t geom[4];
+		std::uint8_t policies[5];
+		if (std::fread(geom, sizeof(geom), 1, fp) != 1)
+			return false;
+		if (std::fread(policies, sizeof(policies), 1, fp) != 1)
+			return false;
+
+		// Geometry derivation is deterministic, so rebuilding the level
+		// yields the same set/way layout the state was saved with.
+		add_level(static_cast<std::size_t>(geom[0]), static_cast<std::size_t>(geom[1]),
+		          static_cast<std::size_t>(geom[2]), static_cast<std::size_t>(geom[3]),
+		          static_cast<ReplacementPolicy>(policies[2]));
+		m_levels.back().set_write_policy(static_cast<WritePolicy>(policies[0]));
+		m_levels.back().set_allocate_policy(static_cast<AllocatePolicy>(policies[1]));
+		if (policies[3] != 0)
+			m_levels.back().set_prefetcher(static_cast<PrefetchPolicy>(policies[3]), policies[4]);
+		if (!m_levels.back().load_state(fp))
+			return false;
+	}
+
+	std::uint64_t tlb_config[5];
+	TlbStats tlb_stats;
+	if (std::fread(tlb_config, sizeof(tlb_config), 1, fp) != 1)
+		return false;
+	if (std::fread(&tlb_stats, sizeof(tlb_stats), 1, fp) != 1)
+		return false;
+	if (tlb_config[0] != 0)
+	{
+		configure_tlb(static_cast<std::size_t>(tlb_config[1]),
+		              static_cast<std::size_t>(tlb_config[2]),
+		              static_cast<std::size_t>(tlb_config[3]),
+		              static_cast<std::size_t>(tlb_config[4]));
+		m_tlb_stats = tlb_stats;
+		if (!m_tlb[0].load_state(fp))
+			return false;
+	}
+
+	std::uint64_t cores = 1;
+	CoherenceStats coherence;
+	if (std::fread(&cores, sizeof(cores), 1, fp) != 1)
+		return false;
+	if (std::fread(&coherence, sizeof(coherence), 1, fp) != 1)
+		return false;
+	set_cores(static_cast<std::size_t>(cores));
+	m_coherence = coherence;
+	std::uint64_t hint_counters[2];
+	if (std::fread(hint_counters, sizeof(hint_counters), 1, fp) != 1)
+		return false;
+	m_streaming_accesses = hint_counters[0];
+	m_uncacheable_accesses = hint_counters[1];
+	for (std::vector<CacheLevel> &core_levels : m_private)
+		for (CacheLevel &lvl : core_levels)
+			if (!lvl.load_state(fp))
+				return false;
+	return true;
+}
+
+void MultiLevelCache::rebase(std::intptr_t delta)
+{
+	if (delta == 0)
+		return;
+	for (CacheLevel &lvl : m_levels)
+		lvl.rebase(delta);
+	for (std::vector<CacheLevel> &core_levels : m_private)
+		for (CacheLevel &lvl : core_levels)
+			lvl.rebase(delta);
+	if (m_tlb_enabled)
+		m_tlb[0].rebase(delta);
+}
+
+void MultiLevelCache::write_json(std::ostream &os) const
+{
+	os << "{\"levels\":" << m_levels.size()
+	   << ",\"memory_latency\":" << m_memory_latency
+	   << ",\"accesses\":" << m_total_accesses
+	   << ",\"hits\":" << m_total_hits
+	   << ",\"misses\":" << m_total_misses
+	   << ",\"total_penalty\":" << m_total_penalty
+	   << ",\"tlb\":{\"enabled\":" << (m_tlb_enabled ? "true" : "false")
+	   << ",\"entries\":" << m_tlb_entries
+	   << ",\"page_size\":" << m_tlb_page_size
+	   << ",\"walk_penalty\":" << m_page_walk_penalty
+	   << ",\"accesses\":" << m_tlb_stats.accesses
+	   << ",\"hits\":" << m_tlb_stats.hits
+	   << ",\"misses\":" << m_tlb_stats.misses
+	   << ",\"walk_cycles\":" << m_tlb_stats.walk_cycles
+	   << "},\"cores\":" << m_num_cores
+	   << ",\"coherence\":{\"invalidations\":" << m_coherence.invalidations
+	   << ",\"inval_writebacks\":" << m_coherence.inval_writebacks
+	   << ",\"coherence_misses\":" << m_coherence.coherence_misses
+	   << ",\"dirty_transfers\":" << m_coherence.dirty_transfers
+	   << "},\"streaming_accesses\":" << m_streaming_accesses
+	   << ",\"uncacheable_accesses\":" << m_uncacheable_accesses
+	   << ",\"per_level\":[";
+	for (std::size_t i = 0; i < m_levels.size(); ++i)
+	{
+		CacheLevelStats st = level_totals(i);
+		if (i)
+			os << ",";
+		os << "{\"accesses\":" << st.accesses
+		   << ",\"hits\":" << st.hits
+		   << ",\"misses\":" << st.misses
+		   << ",\"miss_penalty\":" << st.miss_penalty_accum
+		   << ",\"writebacks\":" << st.writebacks
+		   << ",\"write_throughs\":" << st.write_throughs
+		   << ",\"prefetch_issued\":" << st.prefetch_issued
+		   << ",\"prefetch_useful\":" << st.prefetch_useful
+		   << "}";
+	}
+	os << "]}";
+}
+
+void MultiLevelCache::write_csv_header(std::ostream &os) const
+{
+	os << "cache_accesses,cache_hits,cache_misses,cache_penalty,"
+	   << "tlb_hits,tlb_misses,tlb_walk_cycles";
+	for (std::size_t i = 0; i < m_levels.size(); ++i)
+		os << ",l" << (i + 1) << "_hits,l" << (i + 1) << "_misses,l" << (i + 1) << "_penalty";
+}
+
+void MultiLevelCache::write_csv_fields(std::ostream &os) const
+{
+	os << m_total_accesses << "," << m_total_hits << ","
+	   << m_total_misses << "," << m_total_penalty << ","
+	   << m_tlb_stats.hits << "," << m_tlb_stats.misses << ","
+	   << m_tlb_stats.walk_cycles;
+	for (std::size_t i = 0; i < m_levels.size(); ++i)
+	{
+		CacheLevelStats st = level_totals(i);
+		os << "," << st.hits << "," << st.misses << "," << st.miss_penalty_accum;
+	}
+}
+
+void MultiLevelCache::dump_stats(std::ostream &os) const
+{
+	os << "Multi-level cache statistics:\n";
+	os << "  Levels: " << m_levels.size() << "\n";
+	os << "  Main memory latency: " << m_memory_latency << " cycles\n";
+	os << "  Total accesses: " << m_total_accesses << "\n";
+	os << "  Total hits:     " << m_total_hits << "\n";
+	os << "  Total misses:   " << m_total_misses << "\n";
+	double global_hit_ratio = 0.0;
+	if (m_total_accesses)
+		global_hit_ratio = 100.0 * static_cast<double>(m_total_hits) / static_cast<double>(m_total_accesses);
+	os << "  Global hit ratio: " << std::fixed << std::setprecision(2)
+	   << global_hit_ratio << "%\n";
+	double avg_penalty = 0.0;
+	if (m_total_accesses)
+		avg_penalty = static_cast<double>(m_total_penalty) / static_cast<double>(m_total_accesses);
+	os << "  Avg access penalty: " << avg_penalty << " cycles/access\n";
+
+	if (m_streaming_accesses || m_uncacheable_accesses)
+		os << "  Hinted accesses: streaming=" << m_streaming_accesses
+		   << ", uncacheable=" << m_uncacheable_accesses << "\n";
+
+	if (!m_private.empty())
+	{
+		os << "  Cores: " << m_num_cores << " (private L1..L"
+		   << m_private[0].size() << " per core, shared L"
+		   << m_levels.size() << ")\n";
+		os << "  Coherence: invalidations=" << m_coherence.invalidations
+		   << ", invalidation writebacks=" << m_coherence.inval_writebacks
+		   << ", coherence misses=" << m_coherence.coherence_misses
+		   << ", dirty transfers=" << m_coherence.dirty_transfers << "\n";
+	}
+
+	if (m_tlb_enabled)
+	{
+		os << "  TLB: " << m_tlb_entries << " entries, page size="
+		   << m_tlb_page_size << " bytes, assoc=" << m_tlb[0].associativity()
+		   << "-way, walk penalty=" << m_page_walk_penalty << " cycles\n";
+		os << "    accesses=" << m_tlb_stats.accesses
+		   << ", hits=" << m_tlb_stats.hits
+		   << ", misses=" << m_tlb_stats.misses;
+		double tlb_hit_ratio = 0.0;
+		if (m_tlb_stats.accesses)
+			tlb_hit_ratio = 100.0 * static_cast<double>(m_tlb_stats.hits)
+			                      / static_cast<double>(m_tlb_stats.accesses);
+		os << ", hit ratio=" << std::fixed << std::setprecision(2) << tlb_hit_ratio
+		   << "%, walk cycles=" << m_tlb_stats.walk_cycles << "\n";
+	}
+
+	os << "\nPer-level details:\n";
+	if (m_private.empty())
+	{
+		for (std::size_t i = 0; i < m_levels.size(); ++i)
+			dump_level(os, "L" + std::to_string(i + 1), m_levels[i]);
+	}
+	else
+	{
+		// Topology mode: per-core private levels, then the shared level.
+		for (std::size_t c = 0; c < m_num_cores; ++c)
+			for (std::size_t i = 0; i < m_private[c].size(); ++i)
+				dump_level(os, "Core " + std::to_string(c) + " L" + std::to_string(i + 1),
+				           m_private[c][i]);
+		dump_level(os, "Shared L" + std::to_string(m_levels.size()), m_levels.back());
+	}
+}
 
-	std::uint64_t m_total_accesses = 0;
-	std::uint64_t m_total_hits = 0;   // hit in any cache level
-	std::uint64_t m_total_misses = 0; // went to main memory
-	std::uint64_t m_total_penalty = 0; // total cycles for all accesses
-};
+void MultiLevelCache::dump_level(std::ostream &os, const std::string &label, const CacheLevel &lvl)
+{
+	const CacheLevelStats &st = lvl.stats();
+	os << "  " << label << ": size=" << lvl.size_bytes()
+	   << " bytes, block=" << lvl.block_size()
+	   << " bytes, assoc=" << lvl.associativity()
+	   << "-way, sets=" << lvl.num_sets()
+	   << ", latency=" << lvl.latency() << " cycles, "
+	   << replacement_policy_name(lvl.replacement_policy()) << ", "
+	   << (lvl.write_policy() == WritePolicy::WriteBack ? "write-back" : "write-through")
+	   << "/"
+	   << (lvl.allocate_policy() == AllocatePolicy::WriteAllocate ? "write-allocate" : "no-write-allocate");
+	if (lvl.prefetch_policy() != PrefetchPolicy::None)
+		os << ", prefetch=" << prefetch_policy_name(lvl.prefetch_policy())
+		   << " (degree " << lvl.prefetch_degree() << ")";
+	os << "\n";
+	os << "     accesses=" << st.accesses
+	   << ", hits=" << st.hits
+	   << ", misses=" << st.misses
+	   << ", writebacks=" << st.writebacks
+	   << ", write-throughs=" << st.write_throughs;
+	double hit_ratio = 0.0;
+	if (st.accesses)
+		hit_ratio = 100.0 * static_cast<double>(st.hits) / static_cast<double>(st.accesses);
+	os << ", hit ratio=" << std::fixed << std::setprecision(2)
+	   << hit_ratio << "%";
+	double avg_miss_penalty = 0.0;
+	if (st.misses)
+		avg_miss_penalty = static_cast<double>(st.miss_penalty_accum) / static_cast<double>(st.misses);
+	os << ", avg miss penalty to lower levels=" << avg_miss_penalty << " cycles\n";
+	if (lvl.prefetch_policy() != PrefetchPolicy::None)
+	{
+		double accuracy = 0.0;
+		if (st.prefetch_issued)
+			accuracy = 100.0 * static_cast<double>(st.prefetch_useful)
+			                 / static_cast<double>(st.prefetch_issued);
+		os << "     prefetch issued=" << st.prefetch_issued
+		   << ", useful=" << st.prefetch_useful
+		   << ", accuracy=" << std::fixed << std::setprecision(2) << accuracy << "%\n";
+	}
+}
+
+CacheLevelStats MultiLevelCache::level_totals(std::size_t i) const
+{
+	if (m_private.empty() || i + 1 >= m_levels.size())
+		return m_levels[i].stats();
+	CacheLevelStats sum;
+	for (const std::vector<CacheLevel> &core_levels : m_private)
+	{
+		const CacheLevelStats &st = core_levels[i].stats();
+		sum.accesses += st.accesses;
+		sum.hits += st.hits;
+		sum.misses += st.misses;
+		sum.miss_penalty_accum += st.miss_penalty_accum;
+		sum.writebacks += st.writebacks;
+		sum.write_throughs += st.write_throughs;
+		sum.prefetch_issued += st.prefetch_issued;
+		sum.prefetch_useful += st.prefetch_useful;
+	}
+	return sum;
+}
+
+std::size_t MultiLevelCache::stack_downstream(CacheLevel *const *stack, std::size_t depth,
+                                              std::size_t level_index) const
+{
+	if (level_index + 1 < depth)
+		return stack[level_index + 1]->latency();
+	return m_memory_latency;
+}
+
+void MultiLevelCache::rebuild_private()
+{
+	m_private.clear();
+	m_coherence = CoherenceStats();
+	if (m_num_cores <= 1 || m_levels.size() < 2)
+		return;
+	m_private.resize(m_num_cores);
+	for (std::size_t c = 0; c < m_num_cores; ++c)
+	{
+		for (std::size_t i = 0; i + 1 < m_levels.size(); ++i)
+		{
+			const CacheLevel &proto = m_levels[i];
+			m_private[c].emplace_back(proto.size_bytes(), proto.block_size(),
+			                          proto.associativity(), proto.latency(), i,
+			                          proto.replacement_policy());
+			CacheLevel &replica = m_private[c].back();
+			replica.set_write_policy(proto.write_policy());
+			replica.set_allocate_policy(proto.allocate_policy());
+			if (proto.prefetch_policy() != PrefetchPolicy::None)
+				replica.set_prefetcher(proto.prefetch_policy(), proto.prefetch_degree());
+			replica.set_stat_scale(m_sample_scale);
+		}
+	}
+}
 
 // -------------------------- Global API ---------------------------- //
 
-static MultiLevelCache g_cache;
+MultiLevelCache g_cache;
 
-// Initialize cache with two default levels (L1, L2).
-// Users can instead call cache_reset() + cache_add_level() manually.
-void cache_init_default()
+// The simulated hierarchy is shared state; accesses from concurrent
+// allocator threads are serialized here so LFU/LRU metadata and the stats
+// counters stay consistent.
+std::mutex g_cache_lock;
+
+// Configure a cache instance with the two default levels (L1, L2).
+// Shared between the global cache below and per-context instances.
+void cache_setup_default_levels(MultiLevelCache &cache)
 {
-	g_cache.reset();
+	// Preserve a core topology chosen before the allocator's lazy setup
+	// runs, the same way the sampling scale is re-applied by the caller.
+	std::size_t cores = cache.cores();
+	cache.reset();
 	// Example defaults:
 	//   L1: 4 KB, 64-byte blocks, 4-way set-associative, 1 cycle latency.
 	//   L2: 32 KB, 64-byte blocks, 8-way set-associative, 8 cycles latency.
-	g_cache.add_level(4 * 1024, 64, 4, 1);
-	g_cache.add_level(32 * 1024, 64, 8, 8);
+	cache.add_level(4 * 1024, 64, 4, 1);
+	cache.add_level(32 * 1024, 64, 8, 8);
 	// Main memory latency (can be overridden).
-	g_cache.set_memory_latency(100);
+	cache.set_memory_latency(100);
+	cache.set_cores(cores);
+}
+
+// Initialize the global cache with the default levels.
+// Users can instead call cache_reset() + cache_add_level() manually.
+void cache_init_default()
+{
+	cache_setup_default_levels(g_cache);
 }
 
 void cache_reset()
@@ -380,9 +1388,10 @@ void cache_reset()
 void cache_add_level(std::size_t size_bytes,
 	                   std::size_t block_size,
 	                   std::size_t associativity,
-	                   std::size_t access_latency_cycles)
+	                   std::size_t access_latency_cycles,
+	                   ReplacementPolicy replacement)
 {
-	g_cache.add_level(size_bytes, block_size, associativity, access_latency_cycles);
+	g_cache.add_level(size_bytes, block_size, associativity, access_latency_cycles, replacement);
 }
 
 void cache_configure_level(std::size_t level_index,
@@ -394,29 +1403,193 @@ void cache_configure_level(std::size_t level_index,
 	g_cache.configure_level(level_index, size_bytes, block_size, associativity, access_latency_cycles);
 }
 
+void cache_configure_level(std::size_t level_index,
+	                        std::size_t size_bytes,
+	                        std::size_t block_size,
+	                        std::size_t associativity,
+	                        std::size_t access_latency_cycles,
+	                        ReplacementPolicy replacement)
+{
+	g_cache.configure_level(level_index, size_bytes, block_size, associativity, access_latency_cycles, replacement);
+}
+
 std::size_t cache_get_level_count()
 {
 	return g_cache.level_count();
 }
 
+// Set a level's write and allocate policies (defaults: write-back,
+// write-allocate).
+void cache_set_write_policy(std::size_t level_index, WritePolicy write_policy,
+	                         AllocatePolicy allocate_policy)
+{
+	g_cache.set_write_policy(level_index, write_policy, allocate_policy);
+}
+
 void cache_set_memory_latency(std::size_t latency_cycles)
 {
 	g_cache.set_memory_latency(latency_cycles);
 }
 
+// Configure the TLB stage (entries == 0 disables it).
+void cache_configure_tlb(std::size_t entries, std::size_t page_size,
+	                      std::size_t associativity, std::size_t walk_penalty_cycles)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.configure_tlb(entries, page_size, associativity, walk_penalty_cycles);
+}
+
+// Switch the TLB between 2 MB huge pages and 4 KB base pages.
+void cache_set_huge_pages(bool enabled)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.set_huge_pages(enabled);
+}
+
+// Attach (or remove, with PrefetchPolicy::None) a level's prefetcher.
+void cache_set_prefetcher(std::size_t level_index, PrefetchPolicy policy, std::size_t degree)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.set_prefetcher(level_index, policy, degree);
+}
+
+// Weight every counter increment by `scale` (used by the allocator's
+// sampled simulation mode, where only every Nth access reaches us).
+void cache_set_sample_scale(std::size_t scale)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.set_sample_scale(scale);
+}
+
+// Select the core topology: 1 keeps the flat single-core hierarchy; with
+// more cores every level but the last becomes a per-core private replica
+// over one shared last level, with MESI-style invalidation between the
+// private copies. Changing the count discards private cache contents.
+void cache_set_cores(std::size_t cores)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.set_cores(cores);
+}
+
+std::size_t cache_get_cores()
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	return g_cache.cores();
+}
+
 // Perform a cache access. The address can be any value the caller
 // wishes to use (e.g., g_heap offset, BlockHeader::id, or a pointer).
-void cache_access(std::uintptr_t addr, bool is_write)
+// `core` identifies the issuing core in topology mode (any value is
+// reduced modulo the core count) and is ignored on a single-core setup;
+// `hint` routes non-temporal/uncached traffic around the hierarchy.
+void cache_access(std::uintptr_t addr, bool is_write, std::size_t core,
+                  AccessHint hint)
 {
-	g_cache.access(addr, is_write);
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.access(addr, is_write, core, hint);
+}
+
+// Ranged variant: simulates [addr, addr + len) at cache-block granularity.
+void cache_access_range(std::uintptr_t addr, std::size_t len, bool is_write,
+                        std::size_t core, AccessHint hint)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.access_range(addr, len, is_write, core, hint);
+}
+
+// Serialize/deserialize the global cache to an already-open stream
+// (used by the allocator's snapshot/restore files).
+bool cache_save(std::FILE *fp)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	return g_cache.save(fp);
+}
+
+bool cache_load(std::FILE *fp)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	return g_cache.load(fp);
+}
+
+// Re-file the global cache's resident lines after the heap arena moved.
+// Without this, every restored tag refers to the dead address space: hot
+// lines never hit again and stale tags can falsely match new addresses.
+void cache_rebase(std::intptr_t delta)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.rebase(delta);
+}
+
+// Machine-readable counterparts of cache_dump_stats().
+void cache_write_json(std::ostream &os)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.write_json(os);
+}
+
+void cache_write_csv_header(std::ostream &os)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.write_csv_header(os);
+}
+
+void cache_write_csv_fields(std::ostream &os)
+{
+	std::lock_guard<std::mutex> guard(g_cache_lock);
+	g_cache.write_csv_fields(os);
 }
 
 // Print cache statistics to std::cout.
 void cache_dump_stats()
 {
+	std::lock_guard<std::mutex> guard(g_cache_lock);
 	g_cache.dump_stats(std::cout);
 }
 
+// Parse policy names for config files and scripts. Both return false
+// for an unknown name, leaving `out` untouched.
+bool replacement_policy_from_name(const std::string &name, ReplacementPolicy &out)
+{
+	if (name == "lfu")
+		out = ReplacementPolicy::LFU;
+	else if (name == "lru")
+		out = ReplacementPolicy::LRU;
+	else if (name == "fifo")
+		out = ReplacementPolicy::FIFO;
+	else if (name == "random")
+		out = ReplacementPolicy::Random;
+	else if (name == "plru" || name == "tree-plru")
+		out = ReplacementPolicy::TreePLRU;
+	else
+		return false;
+	return true;
+}
+
+bool prefetch_policy_from_name(const std::string &name, PrefetchPolicy &out)
+{
+	if (name == "none")
+		out = PrefetchPolicy::None;
+	else if (name == "nextline" || name == "next-line")
+		out = PrefetchPolicy::NextLine;
+	else if (name == "stride")
+		out = PrefetchPolicy::Stride;
+	else
+		return false;
+	return true;
+}
+
+static ReplacementPolicy replacement_policy_from_choice(int choice)
+{
+	switch (choice)
+	{
+	case 2: return ReplacementPolicy::LRU;
+	case 3: return ReplacementPolicy::FIFO;
+	case 4: return ReplacementPolicy::Random;
+	case 5: return ReplacementPolicy::TreePLRU;
+	default: return ReplacementPolicy::LFU;
+	}
+}
+
 // Interactive cache configuration and testing menu.
 void cache_menu_loop()
 {
@@ -433,6 +1606,11 @@ void cache_menu_loop()
 		     << "3) Add cache level\n"
 		     << "4) Configure existing cache level\n"
 		     << "5) Dump cache statistics\n"
+		     << "6) Set write policy for a level\n"
+		     << "7) Configure TLB (0 entries disables)\n"
+		     << "8) Toggle huge pages (2MB vs 4KB)\n"
+		     << "9) Configure prefetcher for a level\n"
+		     << "10) Set core count (private levels over a shared last level)\n"
 		     << "0) Exit cache menu\n"
 		     << "\nallocator>cache> " << std::flush;
 
@@ -463,7 +1641,11 @@ void cache_menu_loop()
 			if (!(cin >> associativity)) break;
 			cout << "Enter access latency (cycles): ";
 			if (!(cin >> latency)) break;
-			cache_add_level(size_bytes, block_size, associativity, latency);
+			int policy_choice;
+			cout << "Replacement policy: 1) LFU  2) LRU  3) FIFO  4) random  5) tree-PLRU: ";
+			if (!(cin >> policy_choice)) break;
+			cache_add_level(size_bytes, block_size, associativity, latency,
+			                replacement_policy_from_choice(policy_choice));
 			break;
 		}
 		case 4:
@@ -492,12 +1674,119 @@ void cache_menu_loop()
 			if (!(cin >> associativity)) break;
 			cout << "Enter new access latency (cycles): ";
 			if (!(cin >> latency)) break;
-			cache_configure_level(level - 1, size_bytes, block_size, associativity, latency);
+			int policy_choice;
+			cout << "Replacement policy: 1) LFU  2) LRU  3) FIFO  4) random  5) tree-PLRU: ";
+			if (!(cin >> policy_choice)) break;
+			cache_configure_level(level - 1, size_bytes, block_size, associativity, latency,
+			                      replacement_policy_from_choice(policy_choice));
 			break;
 		}
 		case 5:
 			cache_dump_stats();
 			break;
+		case 6:
+		{
+			std::size_t level_count = cache_get_level_count();
+			if (level_count == 0)
+			{
+				cout << "No cache levels to configure." << endl;
+				break;
+			}
+
+			std::size_t level;
+			int write_choice, alloc_choice;
+			cout << "Existing levels: " << level_count << " (L1..L" << level_count << ")" << endl;
+			cout << "Select level number to configure (1-based): ";
+			if (!(cin >> level)) break;
+			if (level == 0 || level > level_count)
+			{
+				cout << "Invalid level." << endl;
+				break;
+			}
+			cout << "Write policy: 1) write-back  2) write-through: ";
+			if (!(cin >> write_choice)) break;
+			cout << "Allocate policy: 1) write-allocate  2) no-write-allocate: ";
+			if (!(cin >> alloc_choice)) break;
+			cache_set_write_policy(level - 1,
+			                       write_choice == 2 ? WritePolicy::WriteThrough : WritePolicy::WriteBack,
+			                       alloc_choice == 2 ? AllocatePolicy::NoWriteAllocate : AllocatePolicy::WriteAllocate);
+			break;
+		}
+		case 7:
+		{
+			std::size_t entries, page_size, associativity, walk_penalty;
+			cout << "Enter TLB entries (0 disables): ";
+			if (!(cin >> entries)) break;
+			if (entries == 0)
+			{
+				cache_configure_tlb(0, 0, 0, 0);
+				cout << "TLB disabled." << endl;
+				break;
+			}
+			cout << "Enter page size in bytes (e.g. 4096): ";
+			if (!(cin >> page_size)) break;
+			cout << "Enter associativity (ways, 0 = fully associative): ";
+			if (!(cin >> associativity)) break;
+			cout << "Enter page-walk penalty (cycles): ";
+			if (!(cin >> walk_penalty)) break;
+			cache_configure_tlb(entries, page_size, associativity, walk_penalty);
+			break;
+		}
+		case 8:
+		{
+			int huge_choice;
+			cout << "Page size: 1) 2MB huge pages  2) 4KB base pages: ";
+			if (!(cin >> huge_choice)) break;
+			cache_set_huge_pages(huge_choice == 1);
+			break;
+		}
+		case 9:
+		{
+			std::size_t level_count = cache_get_level_count();
+			if (level_count == 0)
+			{
+				cout << "No cache levels to configure." << endl;
+				break;
+			}
+
+			std::size_t level, degree;
+			int policy_choice;
+			cout << "Existing levels: " << level_count << " (L1..L" << level_count << ")" << endl;
+			cout << "Select level number to configure (1-based): ";
+			if (!(cin >> level)) break;
+			if (level == 0 || level > level_count)
+			{
+				cout << "Invalid level." << endl;
+				break;
+			}
+			cout << "Prefetcher: 0) none  1) next-line  2) stride: ";
+			if (!(cin >> policy_choice)) break;
+			if (policy_choice == 0)
+			{
+				cache_set_prefetcher(level - 1, PrefetchPolicy::None, 1);
+				break;
+			}
+			cout << "Enter prefetch degree (lines per trigger): ";
+			if (!(cin >> degree)) break;
+			cache_set_prefetcher(level - 1,
+			                     policy_choice == 2 ? PrefetchPolicy::Stride : PrefetchPolicy::NextLine,
+			                     degree);
+			break;
+		}
+		case 10:
+		{
+			std::size_t cores;
+			cout << "Current cores: " << cache_get_cores() << endl;
+			cout << "Enter core count (1 = flat hierarchy, max 64): ";
+			if (!(cin >> cores)) break;
+			if (cores > 1 && cache_get_level_count() < 2)
+			{
+				cout << "Need at least two cache levels (private + shared)." << endl;
+				break;
+			}
+			cache_set_cores(cores);
+			break;
+		}
 		case 0:
 			running = false;
 			break;
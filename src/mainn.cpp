@@ -10,188 +10,1028 @@
 //   exit / quit
 
 #include <iostream>
+#include <fstream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <iomanip>
 #include <cctype>
-#include "allocator.cpp"
+#include <chrono>
+#include <thread>
+#include "allocator.hpp"
+#include "cache.hpp"
 
 using namespace std;
 
-std::size_t HEAP_SIZE = 64 * 1024; // 64 KB heap size
-std::uint8_t g_heap[64 * 1024];   // Heap memory
+// The heap arena now lives in allocator.cpp (mmap-backed, lazily
+// committed); its startup size is set below via allocator_set_heap_size().
 
-// Import allocator API implemented in allocator.cpp
-// int allocator_malloc(std::size_t size);
-// int allocator_malloc(std::size_t size, const std::string &strategy);
-// void allocator_free(int id);
-// void allocator_dump();
-// void allocator_stats();
-// bool allocator_read(int id, std::size_t offset, void *dst, std::size_t size);
-// bool allocator_write(int id, std::size_t offset, const void *src, std::size_t size);
+// Fit strategy used when a malloc/malloca command names none; settable
+// via the `strategy` command or a config file.
+static FitStrategy g_default_strategy = FitStrategy::First;
+
+// Parse a size argument with an optional K/M/G suffix (e.g. "64K", "2G").
+static bool parse_size_arg(const std::string &text, std::size_t &out)
+{
+	if (text.empty())
+		return false;
+	std::size_t multiplier = 1;
+	std::string digits = text;
+	char suffix = static_cast<char>(std::tolower(static_cast<unsigned char>(text.back())));
+	if (suffix == 'k' || suffix == 'm' || suffix == 'g')
+	{
+		multiplier = (suffix == 'k') ? 1024ull
+		             : (suffix == 'm') ? 1024ull * 1024
+		                               : 1024ull * 1024 * 1024;
+		digits = text.substr(0, text.size() - 1);
+	}
+	if (digits.empty())
+		return false;
+	for (char c : digits)
+		if (!std::isdigit(static_cast<unsigned char>(c)))
+			return false;
+	out = static_cast<std::size_t>(std::stoull(digits)) * multiplier;
+	return true;
+}
+
+// ------------------------- Trace replay --------------------------- //
+//
+// Binary trace format: a stream of packed 13-byte records.
+//   op     : uint8   (0 = malloc, 1 = free, 2 = write, 3 = read)
+//   arg    : uint32  (malloc: size; free/write/read: malloc ordinal,
+//                     i.e. the 0-based index of the malloc record that
+//                     produced the block being referenced)
+//   offset : uint32  (write/read: byte offset into the block)
+//   length : uint32  (write/read: byte count)
+// Referencing blocks by malloc ordinal keeps traces independent of the
+// runtime ids the allocator happens to hand out.
+
+#pragma pack(push, 1)
+struct TraceRecord
+{
+	std::uint8_t op;
+	std::uint32_t arg;
+	std::uint32_t offset;
+	std::uint32_t length;
+};
+#pragma pack(pop)
+
+enum TraceOp : std::uint8_t
+{
+	TRACE_MALLOC = 0,
+	TRACE_FREE = 1,
+	TRACE_WRITE = 2,
+	TRACE_READ = 3,
+};
+
+// Replay a binary trace file with all per-operation output suppressed,
+// reporting only throughput and the final allocator/cache stats.
+static bool run_replay(const std::string &path)
+{
+	std::FILE *fp = std::fopen(path.c_str(), "rb");
+	if (!fp)
+	{
+		std::cout << "replay: cannot open '" << path << "'\n";
+		return false;
+	}
+
+	std::vector<int> ids;          // malloc ordinal -> allocator id
+	std::vector<std::uint8_t> buf(4096, 0xA5); // scratch payload for read/write
+
+	std::uint64_t ops = 0;
+	auto t_start = std::chrono::steady_clock::now();
+
+	// Read records in batches to keep file I/O off the per-op path.
+	TraceRecord batch[4096];
+	std::size_t n;
+	while ((n = std::fread(batch, sizeof(TraceRecord), 4096, fp)) > 0)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+		{
+			const TraceRecord &rec = batch[i];
+			switch (rec.op)
+			{
+			case TRACE_MALLOC:
+				ids.push_back(allocator_malloc(rec.arg));
+				break;
+			case TRACE_FREE:
+				if (rec.arg < ids.size())
+					allocator_free(ids[rec.arg]);
+				break;
+			case TRACE_WRITE:
+			case TRACE_READ:
+				if (rec.arg < ids.size())
+				{
+					if (rec.length > buf.size())
+						buf.resize(rec.length, 0xA5);
+					if (rec.op == TRACE_WRITE)
+						allocator_write(ids[rec.arg], rec.offset, buf.data(), rec.length);
+					else
+						allocator_read(ids[rec.arg], rec.offset, buf.data(), rec.length);
+				}
+				break;
+			default:
+				break; // unknown op: skip
+			}
+			++ops;
+		}
+	}
+	std::fclose(fp);
+
+	auto t_end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(t_end - t_start).count();
+	double ops_per_sec = (seconds > 0.0) ? static_cast<double>(ops) / seconds : 0.0;
+
+	// Save the full stream state: unsetf(fixed) alone would leave the
+	// modified precision behind and mangle allocator_stats() below.
+	std::ios::fmtflags flags = std::cout.flags();
+	std::streamsize precision = std::cout.precision();
+	std::cout << "Replayed " << ops << " operation(s) in "
+			  << std::fixed << std::setprecision(3) << seconds << " s ("
+			  << std::setprecision(0) << ops_per_sec << " ops/sec)\n";
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+	std::cout << "\n";
+	allocator_stats();
+	return true;
+}
+
+// --------------------- Strategy comparison ------------------------ //
+//
+// Replays the same trace once per fit strategy, each run on its own
+// allocator context (private heap, private cache hierarchy) and its own
+// thread, then prints the end states side by side. Because contexts share
+// nothing, the three replays run fully in parallel.
+
+struct CompareResult
+{
+	const char *strategy_name;
+	std::uint64_t ops = 0;
+	double seconds = 0.0;
+	AllocatorStatsSnapshot stats = {};
+	std::uint64_t cache_accesses = 0;
+	std::uint64_t cache_hits = 0;
+	std::uint64_t cache_penalty = 0;
+};
+
+// Replay an in-memory trace against one context. Same op semantics as
+// run_replay(), minus the file I/O.
+static void replay_into_context(const std::vector<TraceRecord> &trace,
+                                FitStrategy strategy, CompareResult &result)
+{
+	AllocatorContext *ctx = allocator_context_create(HEAP_SIZE, 1);
+
+	std::vector<int> ids;
+	std::vector<std::uint8_t> buf(4096, 0xA5);
+
+	auto t_start = std::chrono::steady_clock::now();
+	for (const TraceRecord &rec : trace)
+	{
+		switch (rec.op)
+		{
+		case TRACE_MALLOC:
+			ids.push_back(allocator_ctx_malloc(ctx, rec.arg, strategy));
+			break;
+		case TRACE_FREE:
+			if (rec.arg < ids.size())
+				allocator_ctx_free(ctx, ids[rec.arg]);
+			break;
+		case TRACE_WRITE:
+		case TRACE_READ:
+			if (rec.arg < ids.size())
+			{
+				if (rec.length > buf.size())
+					buf.resize(rec.length, 0xA5);
+				if (rec.op == TRACE_WRITE)
+					allocator_ctx_write(ctx, ids[rec.arg], rec.offset, buf.data(), rec.length);
+				else
+					allocator_ctx_read(ctx, ids[rec.arg], rec.offset, buf.data(), rec.length);
+			}
+			break;
+		default:
+			break;
+		}
+		++result.ops;
+	}
+	auto t_end = std::chrono::steady_clock::now();
+
+	result.seconds = std::chrono::duration<double>(t_end - t_start).count();
+	result.stats = allocator_ctx_collect_stats(ctx);
+	allocator_ctx_cache_totals(ctx, result.cache_accesses, result.cache_hits,
+	                           result.cache_penalty);
+	allocator_context_destroy(ctx);
+}
+
+static bool run_compare(const std::string &path)
+{
+	std::FILE *fp = std::fopen(path.c_str(), "rb");
+	if (!fp)
+	{
+		std::cout << "compare: cannot open '" << path << "'\n";
+		return false;
+	}
+
+	std::vector<TraceRecord> trace;
+	TraceRecord batch[4096];
+	std::size_t n;
+	while ((n = std::fread(batch, sizeof(TraceRecord), 4096, fp)) > 0)
+		trace.insert(trace.end(), batch, batch + n);
+	std::fclose(fp);
+
+	if (trace.empty())
+	{
+		std::cout << "compare: trace is empty\n";
+		return false;
+	}
+
+	static const FitStrategy strategies[] = {
+		FitStrategy::First, FitStrategy::Best, FitStrategy::Worst};
+	static const char *names[] = {"first-fit", "best-fit", "worst-fit"};
+
+	CompareResult results[3];
+	std::vector<std::thread> workers;
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		results[i].strategy_name = names[i];
+		workers.emplace_back(replay_into_context, std::cref(trace),
+		                     strategies[i], std::ref(results[i]));
+	}
+	for (auto &worker : workers)
+		worker.join();
+
+	std::ios::fmtflags flags = std::cout.flags();
+	std::streamsize precision = std::cout.precision();
+	std::cout << "Strategy comparison: " << trace.size() << " operation(s), heap "
+			  << HEAP_SIZE << " bytes per run\n\n";
+	std::cout << std::left << std::setw(11) << "strategy" << std::right
+			  << std::setw(13) << "ops/sec"
+			  << std::setw(9) << "util%"
+			  << std::setw(9) << "int%"
+			  << std::setw(9) << "ext%"
+			  << std::setw(8) << "fails"
+			  << std::setw(10) << "cache-hit%"
+			  << std::setw(13) << "penalty/acc"
+			  << "\n";
+	for (const CompareResult &r : results)
+	{
+		double ops_per_sec = (r.seconds > 0.0) ? static_cast<double>(r.ops) / r.seconds : 0.0;
+		double hit_pct = (r.cache_accesses != 0)
+			                 ? 100.0 * static_cast<double>(r.cache_hits) / static_cast<double>(r.cache_accesses)
+			                 : 0.0;
+		double avg_penalty = (r.cache_accesses != 0)
+			                     ? static_cast<double>(r.cache_penalty) / static_cast<double>(r.cache_accesses)
+			                     : 0.0;
+		std::cout << std::left << std::setw(11) << r.strategy_name << std::right
+				  << std::setw(13) << std::fixed << std::setprecision(0) << ops_per_sec
+				  << std::setw(9) << std::setprecision(1) << r.stats.utilization_pct
+				  << std::setw(9) << r.stats.internal_frag_pct
+				  << std::setw(9) << r.stats.external_frag_pct
+				  << std::setw(8) << r.stats.alloc_fail
+				  << std::setw(10) << std::setprecision(2) << hit_pct
+				  << std::setw(13) << avg_penalty
+				  << "\n";
+	}
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+	return true;
+}
 
 static void print_help()
 {
 	std::cout << "Available commands:\n"
 			  << "  malloc <size> [strategy] - allocate <size> bytes using optional strategy (first|best|worst)\n"
+			  << "  realloc <id> <size>      - resize a block (in place when possible; may return a new id)\n"
+			  << "  malloca <size> <align>   - allocate with a power-of-two alignment (e.g. 64, 4096)\n"
 			  << "  free <id>                - free the block identified by <id>\n"
+			  << "  hint <id> <kind>         - set a block's cache hint: normal | streaming | uncacheable\n"
 			  << "  dump                     - show all memory blocks\n"
-			  << "  stats                    - show allocator statistics (e.g., fragmentation)\n"
+			  << "  stats [json]             - show allocator statistics (json: machine-readable)\n"
+			  << "  timing reset             - clear the per-operation host-timing histograms\n"
+			  << "  sample <n> <file> [fmt]  - append a csv/json stats record every <n> ops; 'sample off' stops\n"
+			  << "  cachesim <mode> [n]      - cache simulation: off | full | sampled (every <n>th access, scaled stats)\n"
 			  << "  read <id> <off> <size>   - read <size> bytes from block <id> at offset <off>\n"
 			  << "  write <id> <off> <data>  - write ASCII <data> into block <id> at offset <off>\n"
+			  << "  fill on|off              - toggle debug fill patterns (garbage detection)\n"
+			  << "  heap <size>[K|M|G]       - set heap size (before first allocation)\n"
+			  << "  shards <n>               - set heap shard count for concurrent use\n"
+			  << "  engine list|buddy        - select the allocation engine (before first allocation)\n"
+			  << "  replay <file>            - replay a binary trace file (see src/mainn.cpp for format)\n"
+			  << "  compare <file>           - replay a trace under every fit strategy in parallel\n"
+			  << "  compact [max_bytes]      - slide live blocks together; optional per-call move budget\n"
+			  << "  snapshot <file>          - checkpoint allocator and cache state to a file\n"
+			  << "  restore <file>           - resume allocator and cache state from a checkpoint\n"
+			  << "  strategy first|best|worst - set the default fit strategy\n"
+			  << "  source <file>            - run commands from a script file ('#' comments)\n"
 			  << "  cache                    - open cache configuration menu\n"
 			  << "  help                     - show this help message\n"
 			  << "  exit | quit              - exit the program\n";
 }
 
-int main()
+static bool run_command_file(const std::string &path);
+
+// Parse and execute one CLI command line. Returns false when the
+// command asked to exit, true otherwise (including errors, which are
+// reported but do not stop an interactive session or a script).
+static bool handle_command(const std::string &line)
+{
+	std::istringstream iss(line);
+	std::string cmd;
+	if (!(iss >> cmd))
+		return true; // empty line
+
+	if (cmd == "malloc")
+	{
+		std::size_t size = 0;
+		if (!(iss >> size))
+		{
+			std::cout << "Usage: malloc <size> [strategy]\n";
+			return true;
+		}
+		std::string strategy;
+		int id;
+		if (iss >> strategy)
+			id = allocator_malloc(size, strategy);
+		else
+			id = allocator_malloc(size, g_default_strategy);
+		std::cout << "Allocated id=" << id << " for size=" << size << "\n";
+	}
+	else if (cmd == "realloc")
+	{
+		int id = -1;
+		std::size_t size = 0;
+		if (!(iss >> id >> size))
+		{
+			std::cout << "Usage: realloc <id> <new_size>\n";
+			return true;
+		}
+		int new_id = allocator_realloc(id, size);
+		if (new_id < 0)
+			std::cout << (size == 0 ? "Freed id=" + std::to_string(id) + "\n"
+			                        : "Realloc failed\n");
+		else if (new_id == id)
+			std::cout << "Resized id=" << id << " in place to size=" << size << "\n";
+		else
+			std::cout << "Relocated id=" << id << " -> id=" << new_id
+					  << " with size=" << size << "\n";
+	}
+	else if (cmd == "malloca")
+	{
+		std::size_t size = 0, align = 0;
+		if (!(iss >> size >> align))
+		{
+			std::cout << "Usage: malloca <size> <align> [strategy]\n";
+			return true;
+		}
+		std::string strategy;
+		int id;
+		if (iss >> strategy)
+			id = allocator_malloc_aligned(size, align, parse_strategy(strategy));
+		else
+			id = allocator_malloc_aligned(size, align, g_default_strategy);
+		if (id < 0)
+			std::cout << "Aligned allocation failed (align must be a power of two)\n";
+		else
+			std::cout << "Allocated id=" << id << " for size=" << size
+					  << " aligned to " << align << "\n";
+	}
+	else if (cmd == "free")
+	{
+		int id = -1;
+		if (!(iss >> id))
+		{
+			std::cout << "Usage: free <id>\n";
+			return true;
+		}
+		allocator_free(id);
+		std::cout << "Freed id=" << id << "\n";
+	}
+	else if (cmd == "hint")
+	{
+		int id = -1;
+		std::string kind;
+		if (!(iss >> id >> kind))
+		{
+			std::cout << "Usage: hint <id> <normal|streaming|uncacheable>\n";
+			return true;
+		}
+		if (allocator_set_block_hint(id, kind))
+			std::cout << "Set hint=" << kind << " on id=" << id << "\n";
+		else
+			std::cout << "Unknown hint '" << kind << "' (normal|streaming|uncacheable)\n";
+	}
+	else if (cmd == "dump")
+	{
+		allocator_dump();
+	}
+	else if (cmd == "stats")
+	{
+		std::string mode;
+		if (iss >> mode && mode == "json")
+			std::cout << allocator_stats_json() << "\n";
+		else
+			allocator_stats();
+	}
+	else if (cmd == "timing")
+	{
+		std::string arg;
+		if (!(iss >> arg) || arg != "reset")
+		{
+			std::cout << "Usage: timing reset\n";
+			return true;
+		}
+		allocator_reset_timing();
+		std::cout << "Host-timing histograms reset\n";
+	}
+	else if (cmd == "sample")
+	{
+		std::string arg;
+		if (!(iss >> arg))
+		{
+			std::cout << "Usage: sample <interval> <file> [csv|json] | sample off\n";
+			return true;
+		}
+		if (arg == "off")
+		{
+			allocator_stop_sampling();
+			std::cout << "Sampling stopped\n";
+			return true;
+		}
+		std::size_t interval = 0;
+		std::string path, format;
+		if (!parse_size_arg(arg, interval) || interval == 0 || !(iss >> path))
+		{
+			std::cout << "Usage: sample <interval> <file> [csv|json] | sample off\n";
+			return true;
+		}
+		iss >> format;
+		bool csv = format != "json";
+		if (allocator_set_sampling(path.c_str(), interval, csv))
+			std::cout << "Sampling every " << interval << " op(s) to '" << path
+					  << "' (" << (csv ? "csv" : "json") << ")\n";
+		else
+			std::cout << "Cannot open '" << path << "' for sampling\n";
+	}
+	else if (cmd == "cachesim")
+	{
+		std::string mode;
+		if (!(iss >> mode))
+		{
+			std::cout << "Usage: cachesim off|full|sampled [interval]\n";
+			return true;
+		}
+		std::size_t interval = 0;
+		iss >> interval;
+		if (!allocator_set_cache_sim(mode, interval))
+		{
+			std::cout << "Usage: cachesim off|full|sampled [interval]\n";
+			return true;
+		}
+		if (mode == "sampled")
+			std::cout << "Cache simulation sampled (stats scaled accordingly)\n";
+		else
+			std::cout << "Cache simulation " << mode << "\n";
+	}
+	else if (cmd == "read")
+	{
+		int id = -1;
+		std::size_t offset = 0;
+		std::size_t size = 0;
+		if (!(iss >> id >> offset >> size))
+		{
+			std::cout << "Usage: read <id> <offset> <size>\n";
+			return true;
+		}
+
+		if (size == 0)
+		{
+			std::cout << "Size must be > 0\n";
+			return true;
+		}
+
+		std::string buffer(size, '\0');
+		bool ok = allocator_read(id, offset, &buffer[0], size);
+		if (!ok)
+		{
+			std::cout << "Read failed (invalid id/range or uninitialized/freed data).\n";
+			return true;
+		}
+
+		std::cout << "Data (ASCII): ";
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			unsigned char c = static_cast<unsigned char>(buffer[i]);
+			if (std::isprint(c))
+				std::cout << static_cast<char>(c);
+			else
+				std::cout << '.';
+		}
+		std::cout << "\nData (hex): ";
+		std::cout << std::hex << std::setfill('0');
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			std::cout << std::setw(2)
+					  << static_cast<unsigned int>(static_cast<unsigned char>(buffer[i]))
+					  << ' ';
+		}
+		std::cout << std::dec << "\n";
+	}
+	else if (cmd == "write")
+	{
+		int id = -1;
+		std::size_t offset = 0;
+		if (!(iss >> id >> offset))
+		{
+			std::cout << "Usage: write <id> <offset> <data...>\n";
+			return true;
+		}
+
+		std::string data;
+		std::getline(iss, data);
+		// Trim leading spaces from remaining line.
+		std::size_t first = data.find_first_not_of(' ');
+		if (first == std::string::npos)
+		{
+			std::cout << "Usage: write <id> <offset> <data...>\n";    
+			return true;
+		}
+		data.erase(0, first);
+
+		std::size_t size = data.size();
+		bool ok = allocator_write(id, offset, data.data(), size);
+		if (!ok)
+		{
+			std::cout << "Write failed (invalid id/range or destination contains uninitialized/freed data).\n";
+			return true;
+		}
+
+		std::cout << "Wrote " << size << " byte(s) to block id=" << id
+				  << " at offset=" << offset << "\n";
+	}
+	else if (cmd == "fill")
+	{
+		std::string mode;
+		if (!(iss >> mode) || (mode != "on" && mode != "off"))
+		{
+			std::cout << "Usage: fill on|off\n";
+			return true;
+		}
+		allocator_set_debug_fill(mode == "on");
+		std::cout << "Debug fill patterns " << (mode == "on" ? "enabled" : "disabled") << "\n";
+	}
+	else if (cmd == "shards")
+	{
+		std::size_t n = 0;
+		if (!(iss >> n) || n == 0)
+		{
+			std::cout << "Usage: shards <n>\n";
+			return true;
+		}
+		allocator_set_shards(n);
+		std::cout << "Heap shards set to " << n
+				  << " (effective before the first allocation)\n";
+	}
+	else if (cmd == "engine")
+	{
+		std::string name;
+		if (!(iss >> name) || (name != "list" && name != "buddy"))
+		{
+			std::cout << "Usage: engine list|buddy\n";
+			return true;
+		}
+		allocator_set_engine(name);
+		std::cout << "Allocation engine set to " << name
+				  << " (effective before the first allocation)\n";
+	}
+	else if (cmd == "heap")
+	{
+		std::string arg;
+		std::size_t bytes = 0;
+		if (!(iss >> arg) || !parse_size_arg(arg, bytes))
+		{
+			std::cout << "Usage: heap <size>[K|M|G]\n";
+			return true;
+		}
+		allocator_set_heap_size(bytes);
+		std::cout << "Heap size set to " << bytes
+				  << " byte(s) (effective before the first allocation)\n";
+	}
+	else if (cmd == "replay")
+	{
+		std::string path;
+		if (!(iss >> path))
+		{
+			std::cout << "Usage: replay <file>\n";
+			return true;
+		}
+		run_replay(path);
+	}
+	else if (cmd == "compact")
+	{
+		std::size_t budget = 0; // 0 = unbounded
+		std::string arg;
+		if (iss >> arg && !parse_size_arg(arg, budget))
+		{
+			std::cout << "Usage: compact [max_move_bytes[K|M|G]]\n";
+			return true;
+		}
+		auto t0 = std::chrono::steady_clock::now();
+		std::size_t moved = allocator_compact(budget);
+		auto t1 = std::chrono::steady_clock::now();
+		double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		std::ios::fmtflags flags = std::cout.flags();
+		std::streamsize precision = std::cout.precision();
+		std::cout << "Compacted: " << moved << " byte(s) moved in "
+				  << std::fixed << std::setprecision(3) << ms << " ms\n";
+		std::cout.flags(flags);
+		std::cout.precision(precision);
+	}
+	else if (cmd == "snapshot" || cmd == "restore")
+	{
+		std::string path;
+		if (!(iss >> path))
+		{
+			std::cout << "Usage: " << cmd << " <file>\n";
+			return true;
+		}
+		bool ok = (cmd == "snapshot") ? allocator_snapshot(path.c_str())
+		                              : allocator_restore(path.c_str());
+		if (ok)
+			std::cout << (cmd == "snapshot" ? "Snapshot written to '" : "State restored from '")
+					  << path << "'\n";
+		else
+			std::cout << cmd << " failed for '" << path << "'\n";
+	}
+	else if (cmd == "compare")
+	{
+		std::string path;
+		if (!(iss >> path))
+		{
+			std::cout << "Usage: compare <file>\n";
+			return true;
+		}
+		run_compare(path);
+	}
+	else if (cmd == "strategy")
+	{
+		std::string name;
+		if (!(iss >> name) || (name != "first" && name != "best" && name != "worst"))
+		{
+			std::cout << "Usage: strategy first|best|worst\n";
+			return true;
+		}
+		g_default_strategy = parse_strategy(name);
+		std::cout << "Default fit strategy set to " << name << "\n";
+	}
+	else if (cmd == "source")
+	{
+		std::string path;
+		if (!(iss >> path))
+		{
+			std::cout << "Usage: source <file>\n";
+			return true;
+		}
+		return run_command_file(path);
+	}
+	else if (cmd == "cache")
+	{
+		cache_menu_loop();
+	}
+	else if (cmd == "help")
+	{
+		print_help();
+	}
+	else if (cmd == "exit" || cmd == "quit")
+	{
+		return false;
+	}
+	else
+	{
+		std::cout << "Unknown command: " << cmd << " (type 'help' for usage)\n";
+	}
+	return true;
+}
+
+// Execute commands from a script file, one per line; '#' starts a
+// comment. Nested `source` is allowed up to a small depth so a script
+// sourcing itself cannot recurse forever. Returns false if a script
+// line asked to exit.
+static bool run_command_file(const std::string &path)
 {
+	static int depth = 0;
+	if (depth >= 8)
+	{
+		std::cout << "source: nesting too deep (max 8)\n";
+		return true;
+	}
+	std::ifstream in(path);
+	if (!in)
+	{
+		std::cout << "source: cannot open '" << path << "'\n";
+		return true;
+	}
+	++depth;
 	std::string line;
-	print_help();
+	bool keep_running = true;
+	while (keep_running && std::getline(in, line))
+	{
+		std::size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+		keep_running = handle_command(line);
+	}
+	--depth;
+	return keep_running;
+}
 
-	while (true)
+// ---------------------- Startup configuration --------------------- //
+//
+// `--config <file>` applies one directive per line at startup, replacing
+// the interactive menus for scripted runs. '#' starts a comment.
+//
+// Allocator directives (take effect before the first allocation):
+//   heap <size>[K|M|G]
+//   shards <n>
+//   engine list|buddy
+//   strategy first|best|worst
+//   fill on|off
+//   cachesim off|full|sampled [interval]
+//
+// Cache directives, applied afterwards in file order. The first `level`
+// line replaces the default L1/L2 hierarchy; level numbers are 1-based
+// (L1 is 1), so put `level` lines before directives that reference them:
+//   level <size>[K|M|G] <block> <assoc> <latency> [lfu|lru|fifo|random|plru]
+//   write_policy <level> wb|wt wa|nwa
+//   prefetch <level> none|nextline|stride [degree]
+//   tlb <entries> <page_size> <assoc> <walk_penalty>
+//   memory_latency <cycles>
+//   cores <n>
+static bool apply_config_file(const std::string &path)
+{
+	std::ifstream in(path);
+	if (!in)
 	{
-		cout << "\n";
-		std::cout << "allocator> " << std::flush;
-		if (!std::getline(std::cin, line))
-			break;
+		std::cerr << "config: cannot open '" << path << "'\n";
+		return false;
+	}
+
+	// Cache directives are deferred: the allocator's lazy init installs
+	// the default hierarchy, so the file's hierarchy must be applied on
+	// top of an already-initialized allocator.
+	struct Deferred
+	{
+		int line_no;
+		std::string text;
+	};
+	std::vector<Deferred> cache_work;
+	bool have_levels = false;
 
+	std::string line;
+	int line_no = 0;
+	bool ok = true;
+	auto fail = [&](const char *usage) {
+		std::cerr << "config:" << line_no << ": expected: " << usage << "\n";
+		ok = false;
+	};
+
+	while (ok && std::getline(in, line))
+	{
+		++line_no;
+		std::size_t hash = line.find('#');
+		if (hash != std::string::npos)
+			line.erase(hash);
 		std::istringstream iss(line);
-		std::string cmd;
-		if (!(iss >> cmd))
-			continue; // empty line
+		std::string key;
+		if (!(iss >> key))
+			continue;
 
-		if (cmd == "malloc")
+		if (key == "heap")
 		{
-			std::size_t size = 0;
-			if (!(iss >> size))
-			{
-				std::cout << "Usage: malloc <size> [strategy]\n";
-				continue;
-			}
-			std::string strategy;
-			int id;
-			if (iss >> strategy)
-				id = allocator_malloc(size, strategy);
+			std::string arg;
+			std::size_t bytes = 0;
+			if (!(iss >> arg) || !parse_size_arg(arg, bytes))
+				fail("heap <size>[K|M|G]");
 			else
-				id = allocator_malloc(size);
-			std::cout << "Allocated id=" << id << " for size=" << size << "\n";
+				allocator_set_heap_size(bytes);
 		}
-		else if (cmd == "free")
+		else if (key == "shards")
 		{
-			int id = -1;
-			if (!(iss >> id))
-			{
-				std::cout << "Usage: free <id>\n";
-				continue;
-			}
-			allocator_free(id);
-			std::cout << "Freed id=" << id << "\n";
+			std::size_t n = 0;
+			if (!(iss >> n) || n == 0)
+				fail("shards <n>");
+			else
+				allocator_set_shards(n);
 		}
-		else if (cmd == "dump")
+		else if (key == "engine")
 		{
-			allocator_dump();
+			std::string name;
+			if (!(iss >> name) || (name != "list" && name != "buddy"))
+				fail("engine list|buddy");
+			else
+				allocator_set_engine(name);
 		}
-		else if (cmd == "stats")
+		else if (key == "strategy")
 		{
-			allocator_stats();
+			std::string name;
+			if (!(iss >> name) || (name != "first" && name != "best" && name != "worst"))
+				fail("strategy first|best|worst");
+			else
+				g_default_strategy = parse_strategy(name);
 		}
-		else if (cmd == "read")
+		else if (key == "fill")
 		{
-			int id = -1;
-			std::size_t offset = 0;
-			std::size_t size = 0;
-			if (!(iss >> id >> offset >> size))
-			{
-				std::cout << "Usage: read <id> <offset> <size>\n";
-				continue;
-			}
+			std::string mode;
+			if (!(iss >> mode) || (mode != "on" && mode != "off"))
+				fail("fill on|off");
+			else
+				allocator_set_debug_fill(mode == "on");
+		}
+		else if (key == "cachesim")
+		{
+			std::string mode;
+			std::size_t interval = 0;
+			iss >> mode;
+			iss >> interval;
+			if (mode.empty() || !allocator_set_cache_sim(mode, interval))
+				fail("cachesim off|full|sampled [interval]");
+		}
+		else if (key == "level" || key == "write_policy" || key == "prefetch"
+		         || key == "tlb" || key == "memory_latency" || key == "cores")
+		{
+			if (key == "level")
+				have_levels = true;
+			cache_work.push_back({line_no, line});
+		}
+		else
+		{
+			fail("heap|shards|engine|strategy|fill|cachesim|level|write_policy|prefetch|tlb|memory_latency|cores");
+		}
+	}
+	if (!ok)
+		return false;
 
-			if (size == 0)
+	// The allocator configuration is final: initialize now so the lazy
+	// default cache setup runs before (not over) the file's hierarchy.
+	allocator_init();
+	if (have_levels)
+		cache_reset();
+
+	for (const Deferred &work : cache_work)
+	{
+		line_no = work.line_no;
+		std::istringstream iss(work.text);
+		std::string key;
+		iss >> key;
+		if (key == "level")
+		{
+			std::string size_arg, policy_name;
+			std::size_t size_bytes = 0, block = 0, assoc = 0, latency = 0;
+			ReplacementPolicy policy = ReplacementPolicy::LFU;
+			if (!(iss >> size_arg >> block >> assoc >> latency)
+			    || !parse_size_arg(size_arg, size_bytes)
+			    || (iss >> policy_name && !replacement_policy_from_name(policy_name, policy)))
 			{
-				std::cout << "Size must be > 0\n";
-				continue;
+				fail("level <size>[K|M|G] <block> <assoc> <latency> [lfu|lru|fifo|random|plru]");
+				break;
 			}
-
-			std::string buffer(size, '\0');
-			bool ok = allocator_read(id, offset, &buffer[0], size);
-			if (!ok)
+			cache_add_level(size_bytes, block, assoc, latency, policy);
+		}
+		else if (key == "write_policy")
+		{
+			std::size_t level = 0;
+			std::string write_name, alloc_name;
+			if (!(iss >> level >> write_name >> alloc_name)
+			    || level == 0 || level > cache_get_level_count()
+			    || (write_name != "wb" && write_name != "wt")
+			    || (alloc_name != "wa" && alloc_name != "nwa"))
 			{
-				std::cout << "Read failed (invalid id/range or uninitialized/freed data).\n";
-				continue;
+				fail("write_policy <level> wb|wt wa|nwa");
+				break;
 			}
-
-			std::cout << "Data (ASCII): ";
-			for (std::size_t i = 0; i < size; ++i)
+			cache_set_write_policy(level - 1,
+			                       write_name == "wt" ? WritePolicy::WriteThrough : WritePolicy::WriteBack,
+			                       alloc_name == "nwa" ? AllocatePolicy::NoWriteAllocate : AllocatePolicy::WriteAllocate);
+		}
+		else if (key == "prefetch")
+		{
+			std::size_t level = 0, degree = 1;
+			std::string policy_name;
+			PrefetchPolicy policy = PrefetchPolicy::None;
+			if (!(iss >> level >> policy_name)
+			    || level == 0 || level > cache_get_level_count()
+			    || !prefetch_policy_from_name(policy_name, policy))
 			{
-				unsigned char c = static_cast<unsigned char>(buffer[i]);
-				if (std::isprint(c))
-					std::cout << static_cast<char>(c);
-				else
-					std::cout << '.';
+				fail("prefetch <level> none|nextline|stride [degree]");
+				break;
 			}
-			std::cout << "\nData (hex): ";
-			std::cout << std::hex << std::setfill('0');
-			for (std::size_t i = 0; i < size; ++i)
+			iss >> degree;
+			cache_set_prefetcher(level - 1, policy, degree);
+		}
+		else if (key == "tlb")
+		{
+			std::size_t entries = 0, page_size = 0, assoc = 0, walk = 0;
+			if (!(iss >> entries) || (entries != 0 && !(iss >> page_size >> assoc >> walk)))
 			{
-				std::cout << std::setw(2)
-						  << static_cast<unsigned int>(static_cast<unsigned char>(buffer[i]))
-						  << ' ';
+				fail("tlb <entries> <page_size> <assoc> <walk_penalty> (0 entries disables)");
+				break;
 			}
-			std::cout << std::dec << "\n";
+			cache_configure_tlb(entries, page_size, assoc, walk);
 		}
-		else if (cmd == "write")
+		else if (key == "memory_latency")
 		{
-			int id = -1;
-			std::size_t offset = 0;
-			if (!(iss >> id >> offset))
+			std::size_t cycles = 0;
+			if (!(iss >> cycles) || cycles == 0)
 			{
-				std::cout << "Usage: write <id> <offset> <data...>\n";
-				continue;
+				fail("memory_latency <cycles>");
+				break;
 			}
-
-			std::string data;
-			std::getline(iss, data);
-			// Trim leading spaces from remaining line.
-			std::size_t first = data.find_first_not_of(' ');
-			if (first == std::string::npos)
+			cache_set_memory_latency(cycles);
+		}
+		else if (key == "cores")
+		{
+			std::size_t n = 0;
+			if (!(iss >> n) || n == 0)
 			{
-				std::cout << "Usage: write <id> <offset> <data...>\n";    
-				continue;
+				fail("cores <n>");
+				break;
 			}
-			data.erase(0, first);
+			cache_set_cores(n);
+		}
+	}
+	return ok;
+}
 
-			std::size_t size = data.size();
-			bool ok = allocator_write(id, offset, data.data(), size);
-			if (!ok)
+int main(int argc, char **argv)
+{
+	// Flags: [--heap <size>] [--shards <n>] [--engine <list|buddy>]
+	//        [--config <file>] [--replay <file>] [--compare <file>]
+	std::string replay_path;
+	std::string compare_path;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if (arg == "--heap" && i + 1 < argc)
+		{
+			std::size_t bytes = 0;
+			if (!parse_size_arg(argv[++i], bytes))
 			{
-				std::cout << "Write failed (invalid id/range or destination contains uninitialized/freed data).\n";
-				continue;
+				std::cerr << "Invalid heap size: " << argv[i] << "\n";
+				return 1;
 			}
-
-			std::cout << "Wrote " << size << " byte(s) to block id=" << id
-					  << " at offset=" << offset << "\n";
+			allocator_set_heap_size(bytes);
 		}
-		else if (cmd == "cache")
+		else if (arg == "--shards" && i + 1 < argc)
 		{
-			cache_menu_loop();
+			allocator_set_shards(static_cast<std::size_t>(std::stoull(argv[++i])));
 		}
-		else if (cmd == "help")
+		else if (arg == "--engine" && i + 1 < argc)
 		{
-			print_help();
+			allocator_set_engine(argv[++i]);
 		}
-		else if (cmd == "exit" || cmd == "quit")
+		else if (arg == "--config" && i + 1 < argc)
 		{
-			break;
+			// Applied immediately: later flags still override, and a
+			// following --replay/--compare runs against the configured
+			// allocator and cache.
+			if (!apply_config_file(argv[++i]))
+				return 1;
+		}
+		else if (arg == "--replay" && i + 1 < argc)
+		{
+			replay_path = argv[++i];
+		}
+		else if (arg == "--compare" && i + 1 < argc)
+		{
+			compare_path = argv[++i];
 		}
 		else
 		{
-			std::cout << "Unknown command: " << cmd << " (type 'help' for usage)\n";
+			std::cerr << "Usage: " << argv[0] << " [--heap <size>] [--shards <n>] [--engine <list|buddy>] [--config <file>] [--replay <file>] [--compare <file>]\n";
+			return 1;
 		}
 	}
 
+	// Non-interactive mode: run a trace and exit.
+	if (!replay_path.empty())
+		return run_replay(replay_path) ? 0 : 1;
+	if (!compare_path.empty())
+		return run_compare(compare_path) ? 0 : 1;
+
+	std::string line;
+	print_help();
+
+	while (true)
+	{
+		cout << "\n";
+		std::cout << "allocator> " << std::flush;
+		if (!std::getline(std::cin, line))
+			break;
+		if (!handle_command(line))
+			break;
+	}
+
 	return 0;
 }
 